@@ -1,4 +1,12 @@
 require 'mkmf'
 find_library('poker-eval', nil, '/usr/local/lib')
 find_header('poker_defs.h', '/usr/local/include/poker-eval')
+have_header('ruby/thread.h')
+have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
+# --disable-hand-table evaluates 7 card high hands with poker-eval itself
+# instead of the lookup tables built when the extension is loaded
+$defs << '-DRBEVAL_HAND_TABLE' if enable_config('hand-table', true)
+# --disable-simd compares hands one player at a time even on CPUs that
+# run AVX2 instructions
+$defs << '-DRBEVAL_SIMD' if enable_config('simd', true)
 create_makefile("poker_eval_api")
@@ -1,4 +1,19 @@
 #include "ruby.h"
+#ifdef HAVE_RUBY_THREAD_H
+#include "ruby/thread.h"
+#endif
+#include <pthread.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*
  *
@@ -54,15 +69,744 @@
 #include "enumerate.h"
 #include "enumdefs.h"
 
+#if defined(RBEVAL_SIMD) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define RBEVAL_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+ * Counts of one player, one cache line of 64 bits wide counters so that
+ * runs of more than 2^32 samples do not wrap around.
+ */
+typedef struct {
+  uint64_t nscoop;
+  uint64_t nwinhi;
+  uint64_t nlosehi;
+  uint64_t ntiehi;
+  uint64_t nwinlo;
+  uint64_t nloselo;
+  uint64_t ntielo;
+  double ev;
+} rbenum_player_t;
+
+/*
+ * What an enumeration accumulates: the part of poker-eval's
+ * enum_result_t that t_eval reports, without its share tables.
+ */
+typedef struct {
+  rbenum_player_t players[ENUM_MAXPLAYERS];
+  uint64_t nsamples;
+  unsigned int nplayers;
+  enum_game_t game;
+  enum_sample_t sampleType;
+} rbenum_result_t;
+
+static void
+rbenumResultClear(rbenum_result_t *result) {
+  memset(result, '\0', sizeof(rbenum_result_t));
+}
+
+/*
+ * Progress of an enumeration running on several threads: every
+ * monitor->every deals, a thread copies its counts so far to published
+ * and signals monitor->cond, so that another thread can report on
+ * progress without stopping the enumeration.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int every;
+  unsigned int version;
+  int finished;
+} rbenum_monitor_t;
+
+typedef struct {
+  rbenum_monitor_t* monitor;
+  rbenum_result_t published;
+} rbenum_progress_t;
+
+static void
+rbenumPublish(rbenum_progress_t *progress, rbenum_result_t *result) {
+  pthread_mutex_lock(&progress->monitor->lock);
+  memcpy(&progress->published, result, sizeof(rbenum_result_t));
+  progress->monitor->version++;
+  pthread_cond_broadcast(&progress->monitor->cond);
+  pthread_mutex_unlock(&progress->monitor->lock);
+}
+
+/*
+ * Outcome of a showdown between n players: the best high and low values,
+ * one bit per player holding a high (low) hand and one per player
+ * holding the best of them, and how many players share the best. Only
+ * the sides (RBENUM_SIDE_HI, RBENUM_SIDE_LO) set in sides are compared:
+ * nobody holds a hand on the other side and its values are not read.
+ */
+typedef struct {
+  HandVal besthi;
+  LowHandVal bestlo;
+  unsigned int hivalid;
+  unsigned int lovalid;
+  unsigned int hiwin;
+  unsigned int lowin;
+  int hishare;
+  int loshare;
+} rbenum_showdown_t;
+
+#define RBENUM_SIDE_HI 1
+#define RBENUM_SIDE_LO 2
+#define RBENUM_SIDE_HILO (RBENUM_SIDE_HI | RBENUM_SIDE_LO)
+
+/*
+ * Players evaluated or compared at once, RBENUM_LANES / 8 AVX2 registers
+ * of 32 bits values.
+ */
+#define RBENUM_LANES 16
+
+#if ENUM_MAXPLAYERS > RBENUM_LANES
+#error "RBENUM_LANES must hold every player"
+#endif
+
+#ifdef RBEVAL_AVX2
+/*
+ * Set when the extension is loaded if the CPU runs AVX2 instructions.
+ */
+static int rbeval_avx2 = 0;
+#endif
+
+static inline void
+rbenumShowdownScalar(const HandVal hival[], const LowHandVal loval[],
+                     int n, int sides, rbenum_showdown_t* showdown) {
+  int i;
+
+  memset(showdown, '\0', sizeof(rbenum_showdown_t));
+  showdown->besthi = HandVal_NOTHING;
+  showdown->bestlo = LowHandVal_NOTHING;
+  for (i = 0; i < n; i++) {
+    unsigned int bit = 1U << i;
+    if ((sides & RBENUM_SIDE_HI) && hival[i] != HandVal_NOTHING) {
+      showdown->hivalid |= bit;
+      if (hival[i] > showdown->besthi) {
+        showdown->besthi = hival[i];
+        showdown->hiwin = bit;
+      } else if (hival[i] == showdown->besthi) {
+        showdown->hiwin |= bit;
+      }
+    }
+    if ((sides & RBENUM_SIDE_LO) && loval[i] != LowHandVal_NOTHING) {
+      showdown->lovalid |= bit;
+      if (loval[i] < showdown->bestlo) {
+        showdown->bestlo = loval[i];
+        showdown->lowin = bit;
+      } else if (loval[i] == showdown->bestlo) {
+        showdown->lowin |= bit;
+      }
+    }
+  }
+  showdown->hishare = __builtin_popcount(showdown->hiwin);
+  showdown->loshare = __builtin_popcount(showdown->lowin);
+}
+
+#ifdef RBEVAL_AVX2
+/*
+ * Lanes i of the first register and i + 8 of the second that belong to
+ * one of n players.
+ */
+#define RBENUM_AVX2_LANES(n, lanes0, lanes1)				\
+  do {									\
+    const __m256i _iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);	\
+    lanes0 = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _iota);		\
+    lanes1 = _mm256_cmpgt_epi32(_mm256_set1_epi32((n) - 8), _iota);	\
+  } while (0)
+
+#define RBENUM_AVX2_BITS(v0, v1)					\
+  ((unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(v0)) |		\
+   (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(v1)) << 8)
+
+/*
+ * Same as rbenumShowdownScalar with every player compared at once. A
+ * player without a hand is given the NOTHING value, which can only be
+ * the best when nobody has a hand, so the best value is the plain
+ * maximum (minimum for low) of all lanes.
+ */
+static void __attribute__((target("avx2")))
+rbenumShowdownAvx2(const HandVal hival[], const LowHandVal loval[],
+                   int n, int sides, rbenum_showdown_t* showdown) {
+  const __m256i hinothing = _mm256_set1_epi32(HandVal_NOTHING);
+  const __m256i lonothing = _mm256_set1_epi32(LowHandVal_NOTHING);
+  __m256i lanes0, lanes1;
+
+  memset(showdown, '\0', sizeof(rbenum_showdown_t));
+  showdown->besthi = HandVal_NOTHING;
+  showdown->bestlo = LowHandVal_NOTHING;
+  RBENUM_AVX2_LANES(n, lanes0, lanes1);
+
+  if (sides & RBENUM_SIDE_HI) {
+    __m256i hi0 = _mm256_blendv_epi8(hinothing, _mm256_maskload_epi32((const int*)hival, lanes0), lanes0);
+    __m256i hi1 = _mm256_blendv_epi8(hinothing, _mm256_maskload_epi32((const int*)hival + 8, lanes1), lanes1);
+    __m256i best = _mm256_max_epu32(hi0, hi1);
+
+    best = _mm256_max_epu32(best, _mm256_permute2x128_si256(best, best, 1));
+    best = _mm256_max_epu32(best, _mm256_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = _mm256_max_epu32(best, _mm256_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+    showdown->besthi = (HandVal)_mm256_cvtsi256_si32(best);
+    showdown->hivalid = ~RBENUM_AVX2_BITS(_mm256_cmpeq_epi32(hi0, hinothing),
+                                          _mm256_cmpeq_epi32(hi1, hinothing)) & 0xFFFF;
+    showdown->hiwin = RBENUM_AVX2_BITS(_mm256_cmpeq_epi32(hi0, best),
+                                       _mm256_cmpeq_epi32(hi1, best)) & showdown->hivalid;
+    showdown->hishare = __builtin_popcount(showdown->hiwin);
+  }
+
+  if (sides & RBENUM_SIDE_LO) {
+    __m256i lo0 = _mm256_blendv_epi8(lonothing, _mm256_maskload_epi32((const int*)loval, lanes0), lanes0);
+    __m256i lo1 = _mm256_blendv_epi8(lonothing, _mm256_maskload_epi32((const int*)loval + 8, lanes1), lanes1);
+    __m256i best = _mm256_min_epu32(lo0, lo1);
+
+    best = _mm256_min_epu32(best, _mm256_permute2x128_si256(best, best, 1));
+    best = _mm256_min_epu32(best, _mm256_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = _mm256_min_epu32(best, _mm256_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+    showdown->bestlo = (LowHandVal)_mm256_cvtsi256_si32(best);
+    showdown->lovalid = ~RBENUM_AVX2_BITS(_mm256_cmpeq_epi32(lo0, lonothing),
+                                          _mm256_cmpeq_epi32(lo1, lonothing)) & 0xFFFF;
+    showdown->lowin = RBENUM_AVX2_BITS(_mm256_cmpeq_epi32(lo0, best),
+                                       _mm256_cmpeq_epi32(lo1, best)) & showdown->lovalid;
+    showdown->loshare = __builtin_popcount(showdown->lowin);
+  }
+}
+#endif /* RBEVAL_AVX2 */
+
+static inline void
+rbenumShowdown(const HandVal hival[], const LowHandVal loval[],
+               int n, int sides, rbenum_showdown_t* showdown) {
+#ifdef RBEVAL_AVX2
+  if (rbeval_avx2) {
+    rbenumShowdownAvx2(hival, loval, n, sides, showdown);
+    return;
+  }
+#endif
+  rbenumShowdownScalar(hival, loval, n, sides, showdown);
+}
+
+/*
+ * Ranks that count for an 8 or better low.
+ */
+#define RBENUM_LOW8_RANKS \
+  ((1 << StdDeck_Rank_ACE) | ((1 << (StdDeck_Rank_8 + 1)) - 1))
+
+/*
+ * Whether a board with these ranks lets anyone make an 8 or better low
+ * in holdem or omaha: at most two of the five low cards come from the
+ * pocket, the others must be distinct low ranks of the board.
+ */
+static inline int
+rbenumLow8Possible(unsigned int ranks) {
+  return __builtin_popcount(ranks & RBENUM_LOW8_RANKS) >= 3;
+}
+
+#define RBENUM_CARDMASK_RANKS(cards)					\
+  (StdDeck_CardMask_HEARTS(cards) | StdDeck_CardMask_DIAMONDS(cards) |	\
+   StdDeck_CardMask_CLUBS(cards) | StdDeck_CardMask_SPADES(cards))
+
+#ifdef RBEVAL_HAND_TABLE
+/*
+ * Lookup tables evaluating high hands of at most 7 cards, built by
+ * rbHandTableInit from StdDeck_StdRules_EVAL_N itself so that they return
+ * the very same HandVal.
+ *
+ * With at most 7 cards, a hand holding 5 cards of a suit is worth the
+ * best hand of these cards alone (no quads or full house fits in the 2
+ * other cards): flush[] is indexed by the ranks of a suit and is 0 unless
+ * there are at least 5 of them.
+ *
+ * Any other hand is worth the best hand of its multiset of ranks. Every
+ * rank has a multiplier such that the sums of the multipliers of the
+ * cards of two different multisets of at most 7 cards are different:
+ * ranks[] holds that sum for the ranks of a suit, and the sum of the four
+ * suits is turned into an index of values[] by a perfect hash,
+ * (key & RBHAND_ROW_MASK) + offsets[key >> RBHAND_ROW_SHIFT].
+ */
+#define RBHAND_MULTISETS 76155
+#define RBHAND_MAXKEY (7 * 0x494493)
+#define RBHAND_ROW_SHIFT 8
+#define RBHAND_ROW_MASK ((1 << RBHAND_ROW_SHIFT) - 1)
+#define RBHAND_NROWS ((RBHAND_MAXKEY >> RBHAND_ROW_SHIFT) + 1)
+
+static const uint32_t rbhand_multipliers[StdDeck_Rank_COUNT] = {
+  0x2000, 0x8001, 0x11000, 0x3a000, 0x91000, 0x176005, 0x366000,
+  0x41a013, 0x47802e, 0x479068, 0x48c0e4, 0x48f211, 0x494493
+};
+
+typedef struct {
+  int ready;
+  uint32_t ranks[1 << StdDeck_Rank_COUNT];
+  HandVal flush[1 << StdDeck_Rank_COUNT];
+  LowHandVal low8[1 << StdDeck_Rank_COUNT];
+  uint32_t* offsets;
+  HandVal* values;
+} rbhand_table_t;
+
+static rbhand_table_t rbhand_table;
+
+/*
+ * cards must not hold more than 7 cards.
+ */
+static inline HandVal
+rbHandEval7(StdDeck_CardMask cards) {
+  unsigned int hearts = StdDeck_CardMask_HEARTS(cards);
+  unsigned int diamonds = StdDeck_CardMask_DIAMONDS(cards);
+  unsigned int clubs = StdDeck_CardMask_CLUBS(cards);
+  unsigned int spades = StdDeck_CardMask_SPADES(cards);
+  HandVal flush = rbhand_table.flush[hearts] | rbhand_table.flush[diamonds] |
+    rbhand_table.flush[clubs] | rbhand_table.flush[spades];
+  uint32_t key;
+
+  if (flush != 0)
+    return flush;
+
+  key = rbhand_table.ranks[hearts] + rbhand_table.ranks[diamonds] +
+    rbhand_table.ranks[clubs] + rbhand_table.ranks[spades];
+
+  return rbhand_table.values[(key & RBHAND_ROW_MASK) + rbhand_table.offsets[key >> RBHAND_ROW_SHIFT]];
+}
+
+typedef struct {
+  int nkeys;
+  uint32_t keys[RBHAND_MULTISETS];
+  HandVal values[RBHAND_MULTISETS];
+} rbhand_multisets_t;
+
+/*
+ * Add every multiset of at most left cards of ranks rank and above to
+ * multisets, counts[] holding the number of cards of the lower ranks.
+ * The cards of a multiset are given suits in turn, which never makes a
+ * flush out of 7 cards.
+ */
+static void
+rbHandTableMultisets(rbhand_multisets_t* multisets, int counts[], int rank, int left)
+{
+  if (rank == StdDeck_Rank_COUNT) {
+    StdDeck_CardMask cards;
+    uint32_t key = 0;
+    int ncards = 0;
+    int r, k;
+
+    StdDeck_CardMask_RESET(cards);
+    for (r = 0; r < StdDeck_Rank_COUNT; r++) {
+      for (k = 0; k < counts[r]; k++) {
+        StdDeck_CardMask_SET(cards, StdDeck_MAKE_CARD(r, ncards % StdDeck_Suit_COUNT));
+        ncards++;
+      }
+      key += counts[r] * rbhand_multipliers[r];
+    }
+    if (multisets->nkeys < RBHAND_MULTISETS) {
+      multisets->keys[multisets->nkeys] = key;
+      multisets->values[multisets->nkeys] = StdDeck_StdRules_EVAL_N(cards, ncards);
+    }
+    multisets->nkeys++;
+    return;
+  }
+
+  for (counts[rank] = 0; counts[rank] <= StdDeck_Suit_COUNT && counts[rank] <= left; counts[rank]++)
+    rbHandTableMultisets(multisets, counts, rank + 1, left - counts[rank]);
+}
+
+/*
+ * Lowest free slot at or after slot, nextfree[] being a union-find forest
+ * whose roots are the free slots.
+ */
+static int
+rbHandTableNextFree(int nextfree[], int slot)
+{
+  int root = slot;
+
+  while (nextfree[root] != root)
+    root = nextfree[root];
+  while (nextfree[slot] != root) {
+    int next = nextfree[slot];
+    nextfree[slot] = root;
+    slot = next;
+  }
+
+  return root;
+}
+
+/*
+ * Fill the perfect hash offsets: rows with the most keys first, each one
+ * at the lowest offset where all its keys land on free slots.
+ */
+static int
+rbHandTablePlace(rbhand_multisets_t* multisets)
+{
+  int nslots = RBHAND_MULTISETS + RBHAND_ROW_MASK + 1;
+  int* start = ALLOC_N(int, RBHAND_NROWS + 1);
+  int* fill = ALLOC_N(int, RBHAND_NROWS);
+  int* order = ALLOC_N(int, RBHAND_NROWS);
+  uint32_t* sorted = ALLOC_N(uint32_t, RBHAND_MULTISETS);
+  int* nextfree = ALLOC_N(int, nslots + 1);
+  char* used = ALLOC_N(char, nslots);
+  int maxcount = 0;
+  int norder = 0;
+  int i, k, row, count;
+  int ok = 1;
+
+  memset(start, '\0', sizeof(int) * (RBHAND_NROWS + 1));
+  memset(fill, '\0', sizeof(int) * RBHAND_NROWS);
+  memset(used, '\0', nslots);
+  for (i = 0; i <= nslots; i++)
+    nextfree[i] = i;
+
+  for (i = 0; i < RBHAND_MULTISETS; i++)
+    start[(multisets->keys[i] >> RBHAND_ROW_SHIFT) + 1]++;
+  for (row = 0; row < RBHAND_NROWS; row++) {
+    if (start[row + 1] > maxcount)
+      maxcount = start[row + 1];
+    start[row + 1] += start[row];
+  }
+  for (i = 0; i < RBHAND_MULTISETS; i++) {
+    row = multisets->keys[i] >> RBHAND_ROW_SHIFT;
+    sorted[start[row] + fill[row]++] = multisets->keys[i];
+  }
+  for (count = maxcount; count > 0; count--)
+    for (row = 0; row < RBHAND_NROWS; row++)
+      if (start[row + 1] - start[row] == count)
+        order[norder++] = row;
+
+  memset(rbhand_table.offsets, '\0', sizeof(uint32_t) * RBHAND_NROWS);
+  for (i = 0; i < norder && ok; i++) {
+    int lowest = RBHAND_ROW_MASK;
+    int slot;
+
+    row = order[i];
+    for (k = start[row]; k < start[row + 1]; k++)
+      if ((int)(sorted[k] & RBHAND_ROW_MASK) < lowest)
+        lowest = sorted[k] & RBHAND_ROW_MASK;
+
+    for (slot = rbHandTableNextFree(nextfree, lowest); ; slot = rbHandTableNextFree(nextfree, slot + 1)) {
+      int offset = slot - lowest;
+      int fits = 1;
+
+      if (slot + RBHAND_ROW_MASK >= nslots) {
+        ok = 0;
+        break;
+      }
+      for (k = start[row]; k < start[row + 1] && fits; k++)
+        fits = !used[(sorted[k] & RBHAND_ROW_MASK) + offset];
+      if (!fits)
+        continue;
+
+      rbhand_table.offsets[row] = offset;
+      for (k = start[row]; k < start[row + 1]; k++) {
+        int placed = (sorted[k] & RBHAND_ROW_MASK) + offset;
+        used[placed] = 1;
+        nextfree[placed] = placed + 1;
+      }
+      break;
+    }
+  }
+
+  xfree(start);
+  xfree(fill);
+  xfree(order);
+  xfree(sorted);
+  xfree(nextfree);
+  xfree(used);
+
+  return ok;
+}
+
+/*
+ * Build the tables. rbHandEval7 is only used once rbhand_table.ready is
+ * set, which requires every multiset of ranks to read its own value back.
+ */
+static void
+rbHandTableInit(void)
+{
+  rbhand_multisets_t* multisets = ALLOC(rbhand_multisets_t);
+  int counts[StdDeck_Rank_COUNT];
+  unsigned int suit;
+  int i, r;
+
+  for (suit = 0; suit < (1 << StdDeck_Rank_COUNT); suit++) {
+    StdDeck_CardMask cards;
+    int ncards = 0;
+
+    StdDeck_CardMask_RESET(cards);
+    rbhand_table.ranks[suit] = 0;
+    for (r = 0; r < StdDeck_Rank_COUNT; r++) {
+      if (suit & (1 << r)) {
+        StdDeck_CardMask_SET(cards, StdDeck_MAKE_CARD(r, StdDeck_Suit_HEARTS));
+        rbhand_table.ranks[suit] += rbhand_multipliers[r];
+        ncards++;
+      }
+    }
+    rbhand_table.flush[suit] = ncards >= 5 ? StdDeck_StdRules_EVAL_N(cards, ncards) : 0;
+    /*
+     * An 8 or better low only depends on the ranks held, pairs aside
+     */
+    rbhand_table.low8[suit] = StdDeck_Lowball8_EVAL(cards, ncards);
+  }
+
+  multisets->nkeys = 0;
+  rbHandTableMultisets(multisets, counts, 0, 7);
+
+  rbhand_table.offsets = ALLOC_N(uint32_t, RBHAND_NROWS);
+  rbhand_table.values = ALLOC_N(HandVal, RBHAND_MULTISETS + RBHAND_ROW_MASK + 1);
+  rbhand_table.ready = multisets->nkeys == RBHAND_MULTISETS && rbHandTablePlace(multisets);
+
+  if (rbhand_table.ready) {
+    for (i = 0; i < RBHAND_MULTISETS; i++) {
+      uint32_t key = multisets->keys[i];
+      rbhand_table.values[(key & RBHAND_ROW_MASK) + rbhand_table.offsets[key >> RBHAND_ROW_SHIFT]] = multisets->values[i];
+    }
+    for (i = 0; i < RBHAND_MULTISETS && rbhand_table.ready; i++) {
+      uint32_t key = multisets->keys[i];
+      rbhand_table.ready = rbhand_table.values[(key & RBHAND_ROW_MASK) + rbhand_table.offsets[key >> RBHAND_ROW_SHIFT]] == multisets->values[i];
+    }
+  }
+
+  xfree(multisets);
+}
+
+/*
+ * Whether every player's hand is at most 7 cards once the cards are
+ * dealt, which rbHandEval7 requires.
+ */
+static int
+rbHandTableFits(StdDeck_CardMask pockets[], int numToDeal[],
+                StdDeck_CardMask board, int sizeToDeal) {
+  int i, card;
+
+  if (!rbhand_table.ready)
+    return 0;
+
+  for (i = 0; i < sizeToDeal - 1; i++) {
+    int ncards = numToDeal[0] + numToDeal[i + 1];
+    for (card = 0; card < StdDeck_N_CARDS; card++) {
+      if (StdDeck_CardMask_CARD_IS_SET(pockets[i], card) ||
+          StdDeck_CardMask_CARD_IS_SET(board, card))
+        ncards++;
+    }
+    if (ncards > 7)
+      return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Evaluator state of a set of cards, updated one card at a time: the sum
+ * of the rank multipliers, the ranks of each suit and of all suits, the
+ * number of cards of each suit and the suit holding 3 cards or more, -1
+ * if none does.
+ */
+typedef struct {
+  uint32_t key;
+  unsigned int suits[StdDeck_Suit_COUNT];
+  unsigned int ranks;
+  int counts[StdDeck_Suit_COUNT];
+  int flushsuit;
+} rbhand_partial_t;
+
+static inline void
+rbHandPartialAdd(rbhand_partial_t* to, const rbhand_partial_t* from, int card) {
+  int rank = StdDeck_RANK(card);
+  int suit = StdDeck_SUIT(card);
+
+  *to = *from;
+  to->key += rbhand_multipliers[rank];
+  to->suits[suit] |= 1 << rank;
+  to->ranks |= 1 << rank;
+  if (++to->counts[suit] == 3)
+    to->flushsuit = suit;
+}
+
+static void
+rbHandPartialInit(rbhand_partial_t* partial, StdDeck_CardMask cards) {
+  int card;
+
+  memset(partial, '\0', sizeof(rbhand_partial_t));
+  partial->flushsuit = -1;
+  for (card = 0; card < StdDeck_N_CARDS; card++) {
+    if (StdDeck_CardMask_CARD_IS_SET(cards, card)) {
+      rbhand_partial_t next;
+      rbHandPartialAdd(&next, partial, card);
+      *partial = next;
+    }
+  }
+}
+
+/*
+ * The pockets of every player, one lane per player, laid out so that
+ * the AVX2 evaluator loads the same field of 8 players at once. Lanes
+ * past the last player are zero.
+ */
+typedef struct {
+  uint32_t keys[RBENUM_LANES];
+  uint32_t suits[StdDeck_Suit_COUNT][RBENUM_LANES];
+  uint32_t ranks[RBENUM_LANES];
+} rbhand_pockets_t;
+
+static void
+rbHandPocketsInit(rbhand_pockets_t* lanes, StdDeck_CardMask pockets[], int n) {
+  int i, suit;
+
+  memset(lanes, '\0', sizeof(rbhand_pockets_t));
+  for (i = 0; i < n; i++) {
+    rbhand_partial_t pocket;
+    rbHandPartialInit(&pocket, pockets[i]);
+    lanes->keys[i] = pocket.key;
+    for (suit = 0; suit < StdDeck_Suit_COUNT; suit++)
+      lanes->suits[suit][i] = pocket.suits[suit];
+    lanes->ranks[i] = pocket.ranks;
+  }
+}
+
+/*
+ * High (and 8 or better low when low is set) values of n 2 card pockets
+ * with a 5 card board: only the suit of which the board holds 3 cards
+ * or more can make a flush.
+ */
+static inline void
+rbHandPocketsEvalScalar(const rbhand_pockets_t* lanes, int n,
+                        const rbhand_partial_t* board, int low,
+                        HandVal hival[], LowHandVal loval[]) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    uint32_t key = lanes->keys[i] + board->key;
+    HandVal flush = 0;
+
+    if (board->flushsuit >= 0)
+      flush = rbhand_table.flush[lanes->suits[board->flushsuit][i] | board->suits[board->flushsuit]];
+    hival[i] = flush != 0 ? flush :
+      rbhand_table.values[(key & RBHAND_ROW_MASK) + rbhand_table.offsets[key >> RBHAND_ROW_SHIFT]];
+    loval[i] = low ? rbhand_table.low8[lanes->ranks[i] | board->ranks] : LowHandVal_NOTHING;
+  }
+}
+
+#ifdef RBEVAL_AVX2
+/*
+ * Same as rbHandPocketsEvalScalar, looking up 8 players at once with
+ * gathers. The zero lanes past the last player look up valid entries
+ * and are not stored.
+ */
+static void __attribute__((target("avx2")))
+rbHandPocketsEvalAvx2(const rbhand_pockets_t* lanes, int n,
+                      const rbhand_partial_t* board, int low,
+                      HandVal hival[], LowHandVal loval[]) {
+  const __m256i rowmask = _mm256_set1_epi32(RBHAND_ROW_MASK);
+  const __m256i boardkey = _mm256_set1_epi32(board->key);
+  const __m256i boardranks = _mm256_set1_epi32(board->ranks);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i stored[2];
+  int i;
+
+  RBENUM_AVX2_LANES(n, stored[0], stored[1]);
+  for (i = 0; i < n; i += 8) {
+    __m256i key = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)&lanes->keys[i]), boardkey);
+    __m256i offset = _mm256_i32gather_epi32((const int*)rbhand_table.offsets,
+                                            _mm256_srli_epi32(key, RBHAND_ROW_SHIFT), 4);
+    __m256i value = _mm256_i32gather_epi32((const int*)rbhand_table.values,
+                                           _mm256_add_epi32(_mm256_and_si256(key, rowmask), offset), 4);
+
+    if (board->flushsuit >= 0) {
+      __m256i suited = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)&lanes->suits[board->flushsuit][i]),
+                                       _mm256_set1_epi32(board->suits[board->flushsuit]));
+      __m256i flush = _mm256_i32gather_epi32((const int*)rbhand_table.flush, suited, 4);
+      value = _mm256_blendv_epi8(flush, value, _mm256_cmpeq_epi32(flush, zero));
+    }
+    _mm256_maskstore_epi32((int*)&hival[i], stored[i / 8], value);
+
+    if (low) {
+      __m256i ranks = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)&lanes->ranks[i]), boardranks);
+      value = _mm256_i32gather_epi32((const int*)rbhand_table.low8, ranks, 4);
+    } else {
+      value = _mm256_set1_epi32(LowHandVal_NOTHING);
+    }
+    _mm256_maskstore_epi32((int*)&loval[i], stored[i / 8], value);
+  }
+}
+#endif /* RBEVAL_AVX2 */
+
+static inline void
+rbHandPocketsEval(const rbhand_pockets_t* lanes, int n,
+                  const rbhand_partial_t* board, int low,
+                  HandVal hival[], LowHandVal loval[]) {
+#ifdef RBEVAL_AVX2
+  if (rbeval_avx2) {
+    rbHandPocketsEvalAvx2(lanes, n, board, low, hival, loval);
+    return;
+  }
+#endif
+  rbHandPocketsEvalScalar(lanes, n, board, low, hival, loval);
+}
+
+/*
+ * Whether an exhaustive enumeration can deal the board incrementally
+ * (see RBENUM_ENUMERATE_BOARD_D): 2 card pockets that are all known and
+ * a board that ends up with 5 cards.
+ */
+static int
+rbHandPartialFits(StdDeck_CardMask pockets[], int numToDeal[],
+                  StdDeck_CardMask board, int sizeToDeal) {
+  int i, card;
+  int nboard = numToDeal[0];
+
+  if (!rbhand_table.ready || numToDeal[0] == 0)
+    return 0;
+
+  for (card = 0; card < StdDeck_N_CARDS; card++) {
+    if (StdDeck_CardMask_CARD_IS_SET(board, card))
+      nboard++;
+  }
+  if (nboard != 5)
+    return 0;
+
+  for (i = 0; i < sizeToDeal - 1; i++) {
+    int npocket = 0;
+    if (numToDeal[i + 1] != 0)
+      return 0;
+    for (card = 0; card < StdDeck_N_CARDS; card++) {
+      if (StdDeck_CardMask_CARD_IS_SET(pockets[i], card))
+        npocket++;
+    }
+    if (npocket != 2)
+      return 0;
+  }
+
+  return 1;
+}
+
+#else
+#define rbHandEval7(cards) StdDeck_StdRules_EVAL_N(cards, 7)
+#define rbHandTableFits(pockets, numToDeal, board, sizeToDeal) 0
+#endif /* RBEVAL_HAND_TABLE */
+
+#define RBENUM_EVAL_HIGH7(cards)					\
+  (hand7 ? rbHandEval7(cards) : StdDeck_StdRules_EVAL_N(cards, 7))
+
 /* INNER_LOOP is executed in every iteration of the combinatorial enumerator
    macros DECK_ENUMERATE_n_CARDS_D() and DECK_ENUMERATE_PERMUTATIONS_D.  It
    evaluates each player's hand based on the enumerated community cards and
    accumulates statistics on wins, ties, losses, and pot equity.
 
-   Macro argument:
+   Macro arguments:
+   	sides -- the constant RBENUM_SIDE_HI, RBENUM_SIDE_LO or
+                 RBENUM_SIDE_HILO, the sides of the pot the game plays for
    	evalwrap -- code that evaluates pockets[i], board, sharedCards, and/or
         	    unsharedCards[i] as a poker hand, then stores the result
-                    in hival[i] and loval[i] and stores an error code in err
+                    in hival[i] and/or loval[i], depending on sides, and
+                    stores an error code in err
+   INNER_LOOP_ALL takes instead
+   	evalall -- code that stores the values of every player's hand in
+        	   hival[] and loval[] at once, or only in hival[] after
+                   clearing haslow when the deal leaves no low for anyone
+   and both compare the hands with rbenumShowdown. INNER_LOOP_KERNEL is
+   INNER_LOOP_ALL for a constant number of players, nplayers.
+
+   Since sides is a constant, the compiler drops the code of the other
+   side: a high only game never looks at loval[], lopot or the low
+   counters.
    Loop variable: either of
    	StdDeck_CardMask sharedCards;
    	StdDeck_CardMask unsharedCards[];
@@ -70,98 +814,141 @@
    	StdDeck_CardMask pockets[];
         StdDeck_CardMask board;
         int npockets;
+        int weight;
+        int hand7;
+        volatile int *interrupted;
+        rbenum_progress_t *progress;
+        int progress_next;
    Outputs:
-   	enum_result_t *result;
+   	rbenum_result_t *result;
+
+   Every outcome is counted weight times (see INNER_LOOP_CANONICAL).
+
+   High hands of 7 cards are evaluated with rbHandEval7 when hand7 is set
+   (see rbHandTableFits).
+
+   Unless progress is null, result is published every
+   progress->monitor->every iterations.
+
+   The enumeration is abandoned with RBENUM_INTERRUPTED as soon as
+   *interrupted is set, which is how a Ruby thread interrupt reaches a
+   computation running without the GVL.
+
+   Pot fractions are accumulated in result->players[].ev as whole multiples of
+   1/RBENUM_EV_UNIT. RBENUM_EV_UNIT is twice the least common multiple of
+   1..ENUM_MAXPLAYERS, so every split of a hi or lo half pot is an integer
+   number of units, the sums are exact whatever the order of addition and
+   partial results computed by separate threads add up to the very same
+   doubles as a single threaded run.
 */
 
-#define INNER_LOOP(evalwrap)						\
+#define RBENUM_INTERRUPTED 2
+
+#if ENUM_MAXPLAYERS > 12
+#error "RBENUM_EV_UNIT must be divisible by every possible share count"
+#endif
+#define RBENUM_EV_UNIT 55440
+
+#define INNER_LOOP_KERNEL(nplayers, sides, evalall)			\
     do {								\
       int i;								\
-      HandVal hival[ENUM_MAXPLAYERS];					\
-      LowHandVal loval[ENUM_MAXPLAYERS];				\
-      HandVal besthi = HandVal_NOTHING;					\
-      LowHandVal bestlo = LowHandVal_NOTHING;				\
-      int hishare = 0;							\
-      int loshare = 0;							\
+      HandVal hival[RBENUM_LANES];					\
+      LowHandVal loval[RBENUM_LANES];					\
+      rbenum_showdown_t showdown;					\
+      int haslow = ((sides) & RBENUM_SIDE_LO) != 0;			\
       double hipot, lopot;						\
+      if (*interrupted)							\
+        return RBENUM_INTERRUPTED;					\
       /* find winning hands for high and low */				\
-      for (i=0; i<sizeToDeal-1; i++) {					\
-	int err;							\
-        { evalwrap }							\
-        if (err != 0)							\
-          return 1000 + err;						\
-        if (hival[i] != HandVal_NOTHING) {				\
-          if (hival[i] > besthi) {					\
-            besthi = hival[i];						\
-            hishare = 1;						\
-          } else if (hival[i] == besthi) {				\
-            hishare++;							\
-          }								\
-        }								\
-        if (loval[i] != LowHandVal_NOTHING) {				\
-          if (loval[i] < bestlo) {					\
-            bestlo = loval[i];						\
-            loshare = 1;						\
-          } else if (loval[i] == bestlo) {				\
-            loshare++;							\
-          }								\
-        }								\
-      }									\
+      { evalall }							\
+      rbenumShowdown(hival, loval, (nplayers),				\
+                     haslow ? (sides) : ((sides) & RBENUM_SIDE_HI),	\
+                     &showdown);					\
       /* now award pot fractions to winning hands */			\
-      if (bestlo != LowHandVal_NOTHING &&				\
-          besthi != HandVal_NOTHING) {					\
-        hipot = 0.5 / hishare;						\
-        lopot = 0.5 / loshare;						\
-      } else if (bestlo == LowHandVal_NOTHING &&			\
-                 besthi != HandVal_NOTHING) {				\
-        hipot = 1.0 / hishare;						\
+      if ((sides) == RBENUM_SIDE_HILO &&				\
+          showdown.loshare > 0 && showdown.hishare > 0) {		\
+        hipot = (RBENUM_EV_UNIT / 2) / showdown.hishare;		\
+        lopot = (RBENUM_EV_UNIT / 2) / showdown.loshare;		\
+      } else if (((sides) & RBENUM_SIDE_HI) && showdown.hishare > 0) {	\
+        hipot = RBENUM_EV_UNIT / showdown.hishare;			\
         lopot = 0;							\
-      } else if (bestlo != LowHandVal_NOTHING &&			\
-                 besthi == HandVal_NOTHING) {				\
+      } else if (((sides) & RBENUM_SIDE_LO) && showdown.loshare > 0) {	\
         hipot = 0;							\
-        lopot = 1.0 / loshare;						\
+        lopot = RBENUM_EV_UNIT / showdown.loshare;			\
       } else {								\
         hipot = lopot = 0;						\
       }									\
-      for (i=0; i<sizeToDeal-1; i++) {					\
+      for (i=0; i<(nplayers); i++) {					\
+        unsigned int bit = 1U << i;					\
+        rbenum_player_t *counts = &result->players[i];			\
         double potfrac = 0;						\
-        int H = 0, L = 0;						\
-        if (hival[i] != HandVal_NOTHING) {				\
-          if (hival[i] == besthi) {					\
-            H = hishare;						\
+        if (((sides) & RBENUM_SIDE_HI) && (showdown.hivalid & bit)) {	\
+          if (showdown.hiwin & bit) {					\
             potfrac += hipot;						\
-            if (hishare == 1)						\
-              result->nwinhi[i]++;					\
+            if (showdown.hishare == 1)					\
+              counts->nwinhi += weight;				\
              else							\
-              result->ntiehi[i]++;					\
+              counts->ntiehi += weight;				\
           } else {							\
-            result->nlosehi[i]++;					\
+            counts->nlosehi += weight;				\
           }								\
         }								\
-        if (loval[i] != LowHandVal_NOTHING) {				\
-          if (loval[i] == bestlo) {					\
-            L = loshare;						\
+        if (((sides) & RBENUM_SIDE_LO) && (showdown.lovalid & bit)) {	\
+          if (showdown.lowin & bit) {					\
             potfrac += lopot;						\
-            if (loshare == 1)						\
-              result->nwinlo[i]++;					\
+            if (showdown.loshare == 1)					\
+              counts->nwinlo += weight;				\
             else							\
-              result->ntielo[i]++;					\
+              counts->ntielo += weight;				\
           } else {							\
-            result->nloselo[i]++;					\
+            counts->nloselo += weight;				\
           }								\
         }								\
-        result->nsharehi[i][H]++;					\
-        result->nsharelo[i][L]++;					\
-        result->nshare[i][H][L]++;					\
-        if (potfrac > 0.99)						\
-          result->nscoop[i]++;						\
-        result->ev[i] += potfrac;					\
+        if (potfrac > 0.99 * RBENUM_EV_UNIT)				\
+          counts->nscoop += weight;					\
+        counts->ev += potfrac * weight;				\
+      }									\
+      result->nsamples += weight;					\
+      if (progress != 0 && --progress_next == 0) {			\
+        rbenumPublish(progress, result);				\
+        progress_next = progress->monitor->every;			\
       }									\
-      result->nsamples++;						\
     } while (0);
 
+#define INNER_LOOP_ALL(sides, evalall)					\
+  INNER_LOOP_KERNEL(sizeToDeal - 1, sides, evalall)
+
+#define INNER_LOOP(sides, evalwrap)					\
+  INNER_LOOP_ALL(sides, {						\
+    for (i=0; i<sizeToDeal-1; i++) {					\
+      int err;								\
+      { evalwrap }							\
+      if (err != 0)							\
+        return 1000 + err;						\
+    }									\
+  })
+
+/* RBENUM_PLAYERS_SWITCH runs kernel(n), kernel being a macro built on
+   INNER_LOOP_KERNEL, with n the constant number of players from 2 to
+   10 so that each count gets its own copy of the loop, with the player
+   loops unrolled. Other counts share kernel(nplayers). */
+
+#define RBENUM_PLAYERS_SWITCH(nplayers, kernel)				\
+  switch (nplayers) {							\
+  case 2: kernel(2); break;						\
+  case 3: kernel(3); break;						\
+  case 4: kernel(4); break;						\
+  case 5: kernel(5); break;						\
+  case 6: kernel(6); break;						\
+  case 7: kernel(7); break;						\
+  case 8: kernel(8); break;						\
+  case 9: kernel(9); break;						\
+  case 10: kernel(10); break;						\
+  default: kernel(nplayers); break;					\
+  }
+
 #define INNER_LOOP_ANY_HIGH						\
-  INNER_LOOP({								\
+  INNER_LOOP(RBENUM_SIDE_HI, {						\
     StdDeck_CardMask _hand;						\
     StdDeck_CardMask _finalBoard;					\
     StdDeck_CardMask_RESET(_hand);					\
@@ -169,13 +956,12 @@
     StdDeck_CardMask_OR(_finalBoard, board, cardsDealt[0]);		\
     StdDeck_CardMask_OR(_hand, pockets[i], _finalBoard);		\
     StdDeck_CardMask_OR(_hand, _hand, cardsDealt[i + 1]);		\
-    hival[i] = StdDeck_StdRules_EVAL_N(_hand, 7);			\
-    loval[i] = LowHandVal_NOTHING;					\
+    hival[i] = RBENUM_EVAL_HIGH7(_hand);				\
     err = 0;								\
   })
 
 #define INNER_LOOP_ANY_HILO						\
-  INNER_LOOP({								\
+  INNER_LOOP(RBENUM_SIDE_HILO, {					\
     StdDeck_CardMask _hand;						\
     StdDeck_CardMask _finalBoard;					\
     StdDeck_CardMask_RESET(_hand);					\
@@ -183,65 +969,286 @@
     StdDeck_CardMask_OR(_finalBoard, board, cardsDealt[0]);		\
     StdDeck_CardMask_OR(_hand, pockets[i], _finalBoard);		\
     StdDeck_CardMask_OR(_hand, _hand, cardsDealt[i + 1]);		\
-    hival[i] = StdDeck_StdRules_EVAL_N(_hand, 7);			\
+    hival[i] = RBENUM_EVAL_HIGH7(_hand);				\
     loval[i] = StdDeck_Lowball8_EVAL(_hand, 7);				\
     err = 0;								\
   })
 
-#define INNER_LOOP_OMAHA						\
-  INNER_LOOP({								\
-    StdDeck_CardMask _hand;						\
-    StdDeck_CardMask _finalBoard;					\
-    StdDeck_CardMask_RESET(_hand);					\
-    StdDeck_CardMask_RESET(_finalBoard);				\
-    StdDeck_CardMask_OR(_finalBoard, board, cardsDealt[0]);		\
-    StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);		\
-    err = StdDeck_OmahaHiLow8_EVAL(_hand, _finalBoard,                  \
-                                   &hival[i], NULL);			\
-    loval[i] = LowHandVal_NOTHING;					\
-  })
+/* INNER_LOOP_HOLDEM8 is INNER_LOOP_ANY_HILO for games where the low
+   is made with board cards (see rbenumLow8Possible): on boards without
+   three low ranks no low is evaluated at all. */
 
-#define INNER_LOOP_OMAHA8						\
-  INNER_LOOP({								\
-    StdDeck_CardMask _hand;						\
+#define INNER_LOOP_HOLDEM8						\
+  INNER_LOOP_ALL(RBENUM_SIDE_HILO, {					\
     StdDeck_CardMask _finalBoard;					\
-    StdDeck_CardMask_RESET(_hand);					\
     StdDeck_CardMask_RESET(_finalBoard);				\
     StdDeck_CardMask_OR(_finalBoard, board, cardsDealt[0]);		\
-    StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);		\
-    err = StdDeck_OmahaHiLow8_EVAL(_hand, _finalBoard,                  \
-                                   &hival[i], &loval[i]);		\
+    haslow = rbenumLow8Possible(RBENUM_CARDMASK_RANKS(_finalBoard));	\
+    for (i=0; i<sizeToDeal-1; i++) {					\
+      StdDeck_CardMask _hand;						\
+      StdDeck_CardMask_OR(_hand, pockets[i], _finalBoard);		\
+      StdDeck_CardMask_OR(_hand, _hand, cardsDealt[i + 1]);		\
+      hival[i] = RBENUM_EVAL_HIGH7(_hand);				\
+      if (haslow)							\
+        loval[i] = StdDeck_Lowball8_EVAL(_hand, 7);			\
+    }									\
   })
 
-#define INNER_LOOP_7STUDNSQ						\
-  INNER_LOOP({								\
-    StdDeck_CardMask _hand;						\
-    StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);		\
-    hival[i] = StdDeck_StdRules_EVAL_N(_hand, 7);			\
-    loval[i] = StdDeck_Lowball_EVAL(_hand, 7);				\
-    err = 0;								\
-  })
+/*
+ * Two hole cards or three board cards of an Omaha hand: the cards, the
+ * ranks held, the suit they all share (-1 if they differ) and, with
+ * the hand table, the sum of their rank multipliers.
+ */
+typedef struct {
+  StdDeck_CardMask cards;
+  unsigned int ranks;
+  int suit;
+#ifdef RBEVAL_HAND_TABLE
+  uint32_t key;
+#endif
+} rbomaha_part_t;
 
-#define INNER_LOOP_RAZZ							\
-  INNER_LOOP({								\
-    StdDeck_CardMask _hand;						\
-    StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);		\
-    hival[i] = HandVal_NOTHING;						\
-    loval[i] = StdDeck_Lowball_EVAL(_hand, 7);				\
-    err = 0;								\
-  })
+#define RBOMAHA_MAXPAIRS (OMAHA_MAXHOLE * (OMAHA_MAXHOLE - 1) / 2)
+#define RBOMAHA_MAXTRIPLES \
+  (OMAHA_MAXBOARD * (OMAHA_MAXBOARD - 1) * (OMAHA_MAXBOARD - 2) / 6)
 
-#define INNER_LOOP_5DRAW						\
-  INNER_LOOP({								\
-    JokerDeck_CardMask _hand;						\
-    JokerDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);	\
-    hival[i] = JokerDeck_JokerRules_EVAL_N(_hand, 5);			\
-    loval[i] = LowHandVal_NOTHING;					\
-    err = 0;								\
+/*
+ * The pairs of hole cards of a player, computed once per enumeration
+ * since the pockets are known.
+ */
+typedef struct {
+  StdDeck_CardMask cards;
+  int ncards;
+  int npairs;
+  rbomaha_part_t pairs[RBOMAHA_MAXPAIRS];
+} rbomaha_hole_t;
+
+static void
+rbOmahaPart(rbomaha_part_t* part, const int cards[], int ncards) {
+  int i;
+
+  StdDeck_CardMask_RESET(part->cards);
+  part->ranks = 0;
+  part->suit = StdDeck_SUIT(cards[0]);
+#ifdef RBEVAL_HAND_TABLE
+  part->key = 0;
+#endif
+  for (i = 0; i < ncards; i++) {
+    StdDeck_CardMask_SET(part->cards, cards[i]);
+    part->ranks |= 1 << StdDeck_RANK(cards[i]);
+    if (StdDeck_SUIT(cards[i]) != part->suit)
+      part->suit = -1;
+#ifdef RBEVAL_HAND_TABLE
+    part->key += rbhand_multipliers[StdDeck_RANK(cards[i])];
+#endif
+  }
+}
+
+/*
+ * Every combination of size cards out of cards, stored in parts. Returns
+ * the number of parts.
+ */
+static int
+rbOmahaParts(rbomaha_part_t parts[], StdDeck_CardMask cards, int size) {
+  int ncards = 0;
+  int nparts = 0;
+  int picked[3];
+  int list[StdDeck_N_CARDS];
+  int card, a, b, c;
+
+  for (card = 0; card < StdDeck_N_CARDS; card++)
+    if (StdDeck_CardMask_CARD_IS_SET(cards, card))
+      list[ncards++] = card;
+
+  for (a = 0; a < ncards; a++) {
+    picked[0] = list[a];
+    for (b = a + 1; b < ncards; b++) {
+      picked[1] = list[b];
+      if (size == 2) {
+        rbOmahaPart(&parts[nparts++], picked, 2);
+        continue;
+      }
+      for (c = b + 1; c < ncards; c++) {
+        picked[2] = list[c];
+        rbOmahaPart(&parts[nparts++], picked, 3);
+      }
+    }
+  }
+
+  return nparts;
+}
+
+static void
+rbOmahaHoleInit(rbomaha_hole_t* hole, StdDeck_CardMask pocket) {
+  int card;
+
+  hole->cards = pocket;
+  hole->ncards = 0;
+  for (card = 0; card < StdDeck_N_CARDS; card++)
+    if (StdDeck_CardMask_CARD_IS_SET(pocket, card))
+      hole->ncards++;
+  hole->npairs = rbOmahaParts(hole->pairs, pocket, 2);
+}
+
+/*
+ * Whether every pocket is known and holds OMAHA_MINHOLE to OMAHA_MAXHOLE
+ * cards and the board ends up with OMAHA_MINBOARD to OMAHA_MAXBOARD
+ * cards, which is what StdDeck_OmahaHiLow8_EVAL accepts.
+ */
+static int
+rbOmahaFits(StdDeck_CardMask pockets[], int numToDeal[],
+            StdDeck_CardMask board, int sizeToDeal) {
+  int i, card;
+  int nboard = numToDeal[0];
+
+  for (card = 0; card < StdDeck_N_CARDS; card++)
+    if (StdDeck_CardMask_CARD_IS_SET(board, card))
+      nboard++;
+  if (nboard < OMAHA_MINBOARD || nboard > OMAHA_MAXBOARD)
+    return 0;
+
+  for (i = 0; i < sizeToDeal - 1; i++) {
+    int npocket = 0;
+    if (numToDeal[i + 1] != 0)
+      return 0;
+    for (card = 0; card < StdDeck_N_CARDS; card++)
+      if (StdDeck_CardMask_CARD_IS_SET(pockets[i], card))
+        npocket++;
+    if (npocket < OMAHA_MINHOLE || npocket > OMAHA_MAXHOLE)
+      return 0;
+  }
+
+  return 1;
+}
+
+static inline HandVal
+rbOmahaHigh(const rbomaha_part_t* pair, const rbomaha_part_t* triple) {
+  StdDeck_CardMask n5;
+
+#ifdef RBEVAL_HAND_TABLE
+  if (rbhand_table.ready) {
+    uint32_t key = pair->key + triple->key;
+    if (pair->suit >= 0 && pair->suit == triple->suit)
+      return rbhand_table.flush[pair->ranks | triple->ranks];
+    return rbhand_table.values[(key & RBHAND_ROW_MASK) + rbhand_table.offsets[key >> RBHAND_ROW_SHIFT]];
+  }
+#endif
+  StdDeck_CardMask_OR(n5, pair->cards, triple->cards);
+  return StdDeck_StdRules_EVAL_N(n5, 5);
+}
+
+static inline LowHandVal
+rbOmahaLow8(const rbomaha_part_t* pair, const rbomaha_part_t* triple) {
+  StdDeck_CardMask n5;
+
+#ifdef RBEVAL_HAND_TABLE
+  if (rbhand_table.ready)
+    return rbhand_table.low8[pair->ranks | triple->ranks];
+#endif
+  StdDeck_CardMask_OR(n5, pair->cards, triple->cards);
+  return StdDeck_Lowball8_EVAL(n5, 5);
+}
+
+/*
+ * Same values as StdDeck_OmahaHiLow8_EVAL for a hole and the board
+ * of which triples are the combinations of three cards.
+ */
+static inline void
+rbOmahaEval(const rbomaha_hole_t* hole, StdDeck_CardMask board, int nboard,
+            const rbomaha_part_t triples[], int ntriples,
+            HandVal* hival, LowHandVal* loval) {
+  HandVal besthi = HandVal_NOTHING;
+  LowHandVal bestlo = LowHandVal_NOTHING;
+  int eligible = 0;
+  int p, t;
+
+  if (loval != NULL) {
+    StdDeck_CardMask allcards;
+    StdDeck_CardMask_OR(allcards, hole->cards, board);
+    eligible = StdDeck_Lowball8_EVAL(allcards, hole->ncards + nboard) != LowHandVal_NOTHING;
+  }
+
+  for (p = 0; p < hole->npairs; p++) {
+    for (t = 0; t < ntriples; t++) {
+      HandVal curhi = rbOmahaHigh(&hole->pairs[p], &triples[t]);
+      if (curhi > besthi)
+        besthi = curhi;
+      if (eligible) {
+        LowHandVal curlo = rbOmahaLow8(&hole->pairs[p], &triples[t]);
+        if (curlo < bestlo)
+          bestlo = curlo;
+      }
+    }
+  }
+
+  *hival = besthi;
+  if (loval != NULL)
+    *loval = bestlo;
+}
+
+/* INNER_LOOP_OMAHA_ANY evaluates the players with rbOmahaEval when the
+   pairs of their hole cards are precomputed in omahaHoles, and with
+   StdDeck_OmahaHiLow8_EVAL otherwise. The board is split into its
+   triples once per deal for all the players. Lows are only evaluated
+   when low is set and the board has three low ranks. */
+
+#define INNER_LOOP_OMAHA_ANY(low)					\
+  INNER_LOOP_ALL((low) ? RBENUM_SIDE_HILO : RBENUM_SIDE_HI, {		\
+    StdDeck_CardMask _finalBoard;					\
+    StdDeck_CardMask_OR(_finalBoard, board, cardsDealt[0]);		\
+    haslow = (low) &&							\
+      rbenumLow8Possible(RBENUM_CARDMASK_RANKS(_finalBoard));		\
+    if (omahaHoles != NULL) {						\
+      rbomaha_part_t _triples[RBOMAHA_MAXTRIPLES];			\
+      int _ntriples = rbOmahaParts(_triples, _finalBoard, 3);		\
+      for (i=0; i<sizeToDeal-1; i++)					\
+        rbOmahaEval(&omahaHoles[i], _finalBoard, omahaBoard,		\
+                    _triples, _ntriples, &hival[i],			\
+                    haslow ? &loval[i] : NULL);				\
+    } else {								\
+      for (i=0; i<sizeToDeal-1; i++) {					\
+        StdDeck_CardMask _hand;						\
+        int err;							\
+        StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);	\
+        err = StdDeck_OmahaHiLow8_EVAL(_hand, _finalBoard, &hival[i],	\
+                                       haslow ? &loval[i] : NULL);	\
+        if (err != 0)							\
+          return 1000 + err;						\
+      }									\
+    }									\
+  })
+
+#define INNER_LOOP_OMAHA INNER_LOOP_OMAHA_ANY(0)
+
+#define INNER_LOOP_OMAHA8 INNER_LOOP_OMAHA_ANY(1)
+
+#define INNER_LOOP_7STUDNSQ						\
+  INNER_LOOP(RBENUM_SIDE_HILO, {					\
+    StdDeck_CardMask _hand;						\
+    StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);		\
+    hival[i] = RBENUM_EVAL_HIGH7(_hand);				\
+    loval[i] = StdDeck_Lowball_EVAL(_hand, 7);				\
+    err = 0;								\
+  })
+
+#define INNER_LOOP_RAZZ							\
+  INNER_LOOP(RBENUM_SIDE_LO, {						\
+    StdDeck_CardMask _hand;						\
+    StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);		\
+    loval[i] = StdDeck_Lowball_EVAL(_hand, 7);				\
+    err = 0;								\
+  })
+
+#define INNER_LOOP_5DRAW						\
+  INNER_LOOP(RBENUM_SIDE_HI, {						\
+    JokerDeck_CardMask _hand;						\
+    JokerDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);	\
+    hival[i] = JokerDeck_JokerRules_EVAL_N(_hand, 5);			\
+    err = 0;								\
   })
 
 #define INNER_LOOP_5DRAW8						\
-  INNER_LOOP({								\
+  INNER_LOOP(RBENUM_SIDE_HILO, {					\
     JokerDeck_CardMask _hand;						\
     JokerDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);	\
     hival[i] = JokerDeck_JokerRules_EVAL_N(_hand, 5);			\
@@ -250,7 +1257,7 @@
   })
 
 #define INNER_LOOP_5DRAWNSQ						\
-  INNER_LOOP({								\
+  INNER_LOOP(RBENUM_SIDE_HILO, {					\
     JokerDeck_CardMask _hand;						\
     JokerDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);	\
     hival[i] = JokerDeck_JokerRules_EVAL_N(_hand, 5);			\
@@ -259,37 +1266,311 @@
   })
 
 #define INNER_LOOP_LOWBALL						\
-  INNER_LOOP({								\
+  INNER_LOOP(RBENUM_SIDE_LO, {						\
     JokerDeck_CardMask _hand;						\
     JokerDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);	\
-    hival[i] = HandVal_NOTHING;						\
     loval[i] = JokerDeck_Lowball_EVAL(_hand, 5);			\
     err = 0;								\
   })
 
 #define INNER_LOOP_LOWBALL27						\
-  INNER_LOOP({								\
+  INNER_LOOP(RBENUM_SIDE_LO, {						\
     StdDeck_CardMask _hand;						\
     StdDeck_CardMask_OR(_hand, pockets[i], cardsDealt[i + 1]);		\
-    hival[i] = HandVal_NOTHING;						\
     loval[i] = StdDeck_StdRules_EVAL_N(_hand, 5);			\
     err = 0;								\
   })
 
+static inline unsigned int
+rbenumSuitRanks(StdDeck_CardMask cards, int suit) {
+  switch(suit) {
+  case StdDeck_Suit_HEARTS:
+    return StdDeck_CardMask_HEARTS(cards);
+  case StdDeck_Suit_DIAMONDS:
+    return StdDeck_CardMask_DIAMONDS(cards);
+  case StdDeck_Suit_CLUBS:
+    return StdDeck_CardMask_CLUBS(cards);
+  default:
+    return StdDeck_CardMask_SPADES(cards);
+  }
+}
+
+/*
+ * Suits that appear in no pocket, on the board or among the dead cards
+ * are interchangeable: permuting them maps a runout to another one with
+ * the very same outcome. The signature of such a suit is the list of
+ * ranks it was dealt in each set of cardsDealt. A runout is canonical
+ * when the signatures of the unused suits are in decreasing order, and
+ * stands for as many runouts as there are distinct permutations of these
+ * signatures.
+ *
+ * Returns that number, or 0 if the runout is not canonical.
+ */
+static int
+rbenumCanonicalWeight(StdDeck_CardMask cardsDealt[], int nsets,
+                      int unused[], int nunused) {
+  static const int factorial[StdDeck_Suit_COUNT + 1] = { 1, 1, 2, 6, 24 };
+  unsigned int sig[StdDeck_Suit_COUNT][ENUM_MAXPLAYERS + 1];
+  int weight = factorial[nunused];
+  int run = 1;
+  int s, j;
+
+  for(s = 0; s < nunused; s++)
+    for(j = 0; j < nsets; j++)
+      sig[s][j] = rbenumSuitRanks(cardsDealt[j], unused[s]);
+
+  for(s = 1; s < nunused; s++) {
+    int cmp = 0;
+    for(j = 0; j < nsets && cmp == 0; j++)
+      cmp = (sig[s - 1][j] > sig[s][j]) - (sig[s - 1][j] < sig[s][j]);
+    if(cmp < 0)
+      return 0;
+    if(cmp == 0) {
+      run++;
+      weight /= run;
+    } else {
+      run = 1;
+    }
+  }
+
+  return weight;
+}
+
+/* INNER_LOOP_EXHAUSTIVE runs loop for every runout of an exhaustive
+   enumeration. When nunused is not 0, loop is restricted to canonical
+   runouts, with weight set to the number of runouts each of them stands
+   for.
+   Inputs:
+   	StdDeck_CardMask cardsDealt[];
+   	int unused[];
+   	int nunused;
+   Outputs:
+   	int weight;
+*/
+
+#define INNER_LOOP_EXHAUSTIVE(loop)					\
+    do {								\
+      weight = 1;							\
+      if (nunused < 2 ||						\
+          (weight = rbenumCanonicalWeight(cardsDealt, sizeToDeal,	\
+                                          unused, nunused)) != 0) {	\
+        loop								\
+      }									\
+    } while (0);
+
+/* npartitions threads share one exhaustive enumeration by the cards
+   dealt first: the combinations of the first split + 1 cards are taken
+   in turn by each partition, which only deals the cards after them for
+   its own. RBENUM_SPLIT_DEPTH leaves a few thousand prefixes or more to
+   share, each of them followed by at most a thousand runouts or so, and
+   the partitions walk little more than their own share. */
+
+#define RBENUM_SPLIT_DEPTH(ncards) ((ncards) <= 3 ? (ncards) - 1 : (ncards) - 3)
+
+/* RBENUM_ENUMERATE_PARTITION_D deals cardsDealt[] like
+   DECK_ENUMERATE_COMBINATIONS_D, in partition partition of npartitions.
+   The cards to deal are walked one position after the other, each set
+   taking its cards in increasing order, and the combinations of the
+   first _split + 1 positions are the prefixes shared by the partitions:
+   the whole first set with cards to deal when other sets follow it,
+   RBENUM_SPLIT_DEPTH of it otherwise.
+   Inputs:
+   	int numToDeal[];
+   	int sizeToDeal;
+   	int totalToDeal;
+   	StdDeck_CardMask dead;
+   	int partition;
+   	int npartitions;
+   Outputs:
+   	StdDeck_CardMask cardsDealt[];
+*/
+
+#define RBENUM_ENUMERATE_PARTITION_D(action)				\
+do {									\
+  int _live[StdDeck_N_CARDS];						\
+  int _index[StdDeck_N_CARDS];						\
+  int _setOf[StdDeck_N_CARDS];						\
+  int _setEnd[StdDeck_N_CARDS];						\
+  StdDeck_CardMask _used[StdDeck_N_CARDS + 1];				\
+  StdDeck_CardMask _setDealt[StdDeck_N_CARDS + 1];			\
+  int _nlive = 0;							\
+  int _depth = 0;							\
+  int _prefix = 0;							\
+  int _first = 0;							\
+  int _split;								\
+  int _card;								\
+  int _k;								\
+  int _s;								\
+  for (_k = 0; _k < StdDeck_N_CARDS; _k++)				\
+    if (!StdDeck_CardMask_CARD_IS_SET(dead, _k))			\
+      _live[_nlive++] = _k;						\
+  for (_s = 0, _k = 0; _s < sizeToDeal; _s++) {				\
+    int _n;								\
+    StdDeck_CardMask_RESET(cardsDealt[_s]);				\
+    for (_n = 0; _n < numToDeal[_s]; _n++, _k++) {			\
+      _setOf[_k] = _s;							\
+      _setEnd[_k] = _k - _n + numToDeal[_s];				\
+    }									\
+  }									\
+  if (totalToDeal == 0) {						\
+    if (partition == 0) {						\
+      action								\
+    }									\
+    break;								\
+  }									\
+  while (numToDeal[_first] == 0)					\
+    _first++;								\
+  _split = totalToDeal > numToDeal[_first] ? numToDeal[_first] - 1 :	\
+           RBENUM_SPLIT_DEPTH(numToDeal[_first]);			\
+  StdDeck_CardMask_RESET(_used[0]);					\
+  _index[0] = -1;							\
+  while (_depth >= 0) {							\
+    do {								\
+      _index[_depth]++;							\
+    } while (_index[_depth] < _nlive &&					\
+             StdDeck_CardMask_CARD_IS_SET(_used[_depth],		\
+                                          _live[_index[_depth]]));	\
+    if (_index[_depth] > _nlive - (_setEnd[_depth] - _depth)) {		\
+      _depth--;								\
+      continue;								\
+    }									\
+    if (_depth == _split &&						\
+        _prefix++ % (npartitions) != (partition))			\
+      continue;								\
+    _card = _live[_index[_depth]];					\
+    _used[_depth + 1] = _used[_depth];					\
+    StdDeck_CardMask_SET(_used[_depth + 1], _card);			\
+    if (_depth == 0 || _setOf[_depth - 1] != _setOf[_depth])		\
+      StdDeck_CardMask_RESET(_setDealt[_depth + 1]);			\
+    else								\
+      _setDealt[_depth + 1] = _setDealt[_depth];			\
+    StdDeck_CardMask_SET(_setDealt[_depth + 1], _card);			\
+    if (_depth + 1 == _setEnd[_depth])					\
+      cardsDealt[_setOf[_depth]] = _setDealt[_depth + 1];		\
+    if (_depth + 1 < totalToDeal) {					\
+      _depth++;								\
+      _index[_depth] = _setOf[_depth - 1] == _setOf[_depth] ?		\
+                       _index[_depth - 1] : -1;				\
+      continue;								\
+    }									\
+    { action }								\
+  }									\
+} while (0)
+
+#ifdef RBEVAL_HAND_TABLE
+/* RBENUM_ENUMERATE_BOARD_D deals every combination of ncards cards not in
+   dead_cards to board_var, like DECK_ENUMERATE_COMBINATIONS_D with a
+   single set, in partition partition of npartitions as
+   RBENUM_ENUMERATE_PARTITION_D does. The rbhand_partial_t of the board after
+   each card dealt is kept in states[1..ncards], states[0] being the state
+   of the cards known upfront, so that a card dealt at an outer level is
+   added once for all the runouts below it rather than once per runout
+   and per player. */
+
+#define RBENUM_ENUMERATE_BOARD_D(board_var, ncards, dead_cards, states, \
+                                 partition, npartitions, action)	\
+do {									\
+  int _live[StdDeck_N_CARDS];						\
+  int _index[StdDeck_N_CARDS];						\
+  StdDeck_CardMask _dealt[StdDeck_N_CARDS + 1];				\
+  int _nlive = 0;							\
+  int _depth = 0;							\
+  int _split = RBENUM_SPLIT_DEPTH(ncards);				\
+  int _prefix = 0;							\
+  int _k;								\
+  for (_k = 0; _k < StdDeck_N_CARDS; _k++)				\
+    if (!StdDeck_CardMask_CARD_IS_SET(dead_cards, _k))			\
+      _live[_nlive++] = _k;						\
+  StdDeck_CardMask_RESET(_dealt[0]);					\
+  _index[0] = -1;							\
+  while (_depth >= 0) {							\
+    int _card;								\
+    if (++_index[_depth] > _nlive - ((ncards) - _depth)) {		\
+      _depth--;								\
+      continue;								\
+    }									\
+    if (_depth == _split && _prefix++ % (npartitions) != (partition))	\
+      continue;								\
+    _card = _live[_index[_depth]];					\
+    _dealt[_depth + 1] = _dealt[_depth];				\
+    StdDeck_CardMask_SET(_dealt[_depth + 1], _card);			\
+    rbHandPartialAdd(&(states)[_depth + 1], &(states)[_depth], _card);	\
+    if (_depth + 1 < (ncards)) {					\
+      _depth++;								\
+      _index[_depth] = _index[_depth - 1];				\
+      continue;								\
+    }									\
+    board_var = _dealt[ncards];						\
+    { action }								\
+  }									\
+} while (0)
+
+#define INNER_LOOP_PARTIAL_HIGH(nplayers)				\
+  INNER_LOOP_KERNEL(nplayers, RBENUM_SIDE_HI, {				\
+    rbHandPocketsEval(&pocketLanes, (nplayers),				\
+                      &boardStates[numToDeal[0]], 0, hival, loval);	\
+  })
+
+#define INNER_LOOP_PARTIAL_HILO(nplayers)				\
+  INNER_LOOP_KERNEL(nplayers, RBENUM_SIDE_HILO, {			\
+    haslow = rbenumLow8Possible(boardStates[numToDeal[0]].ranks);	\
+    rbHandPocketsEval(&pocketLanes, (nplayers),				\
+                      &boardStates[numToDeal[0]], haslow, hival, loval); \
+  })
+
+#define RBENUM_PARTIAL_HIGH(nplayers)					\
+  RBENUM_ENUMERATE_BOARD_D(cardsDealt[0], numToDeal[0], dead, boardStates, \
+                           partition, npartitions,			\
+                           INNER_LOOP_EXHAUSTIVE(INNER_LOOP_PARTIAL_HIGH(nplayers)))
+
+#define RBENUM_PARTIAL_HILO(nplayers)					\
+  RBENUM_ENUMERATE_BOARD_D(cardsDealt[0], numToDeal[0], dead, boardStates, \
+                           partition, npartitions,			\
+                           INNER_LOOP_EXHAUSTIVE(INNER_LOOP_PARTIAL_HILO(nplayers)))
+#endif /* RBEVAL_HAND_TABLE */
+
 static int 
 rbenumExhaustive(enum_game_t game, StdDeck_CardMask pockets[],
 		 int numToDeal[],
                StdDeck_CardMask board, StdDeck_CardMask dead,
-               int sizeToDeal, enum_result_t *result) {
+               int sizeToDeal, rbenum_result_t *result,
+               int partition, int npartitions, int canonical,
+               volatile int *interrupted, rbenum_progress_t *progress) {
   int totalToDeal = 0;
+  int progress_next = progress != 0 ? progress->monitor->every : 0;
+  int unused[StdDeck_Suit_COUNT];
+  int nunused = 0;
+  int weight = 1;
+  int hand7;
+  rbomaha_hole_t omahaHolesStorage[ENUM_MAXPLAYERS];
+  rbomaha_hole_t *omahaHoles = NULL;
+  int omahaBoard = 0;
   int i;
-  enumResultClear(result);
+  rbenumResultClear(result);
   StdDeck_CardMask cardsDealt[ENUM_MAXPLAYERS + 1];
   memset(cardsDealt, 0, sizeof(StdDeck_CardMask) * (ENUM_MAXPLAYERS + 1));
   if (sizeToDeal - 1 > ENUM_MAXPLAYERS)
     return 1;
+  /*
+   * Set upfront: an enumeration stopped at a deadline is still a valid,
+   * partial, result.
+   */
+  result->game = game;
+  result->nplayers = sizeToDeal - 1;
+  result->sampleType = ENUM_EXHAUSTIVE;
   for(i = 0; i < sizeToDeal; i++)
     totalToDeal += numToDeal[i];
+  hand7 = rbHandTableFits(pockets, numToDeal, board, sizeToDeal);
+  if ((game == game_omaha || game == game_omaha8) &&
+      rbOmahaFits(pockets, numToDeal, board, sizeToDeal)) {
+    for(i = 0; i < sizeToDeal - 1; i++)
+      rbOmahaHoleInit(&omahaHolesStorage[i], pockets[i]);
+    omahaHoles = omahaHolesStorage;
+    omahaBoard = numToDeal[0];
+    for(i = 0; i < StdDeck_N_CARDS; i++)
+      if(StdDeck_CardMask_CARD_IS_SET(board, i))
+        omahaBoard++;
+  }
 
   /*
    * Cards in pockets or in the board must not be dealt 
@@ -299,87 +1580,170 @@ rbenumExhaustive(enum_game_t game, StdDeck_CardMask pockets[],
     StdDeck_CardMask_OR(dead, dead, pockets[i]);
   }
 
-  if (game == game_holdem) {
-    if(totalToDeal > 0) {
-      DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-				    sizeToDeal, numToDeal,
-				    dead, INNER_LOOP_ANY_HIGH);
-    } else {
-      INNER_LOOP_ANY_HIGH;
+  if (canonical) {
+    for(i = StdDeck_Suit_FIRST; i <= StdDeck_Suit_LAST; i++) {
+      if (rbenumSuitRanks(dead, i) == 0)
+        unused[nunused++] = i;
     }
-  } else if (game == game_holdem8) {
-    if(totalToDeal > 0) {
-      DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-				    sizeToDeal, numToDeal,
-				    dead, INNER_LOOP_ANY_HILO);
+  }
+
+#ifdef RBEVAL_HAND_TABLE
+  if ((game == game_holdem || game == game_holdem8) &&
+      rbHandPartialFits(pockets, numToDeal, board, sizeToDeal)) {
+    rbhand_pockets_t pocketLanes;
+    rbhand_partial_t boardStates[6];
+
+    rbHandPocketsInit(&pocketLanes, pockets, sizeToDeal - 1);
+    rbHandPartialInit(&boardStates[0], board);
+    if (game == game_holdem) {
+      RBENUM_PLAYERS_SWITCH(sizeToDeal - 1, RBENUM_PARTIAL_HIGH);
     } else {
-      INNER_LOOP_ANY_HILO;
+      RBENUM_PLAYERS_SWITCH(sizeToDeal - 1, RBENUM_PARTIAL_HILO);
     }
+    return 0;
+  }
+#endif
+
+  if (game == game_holdem) {
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_ANY_HIGH));
+  } else if (game == game_holdem8) {
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_HOLDEM8));
   } else if (game == game_omaha) {
-    if(totalToDeal > 0) {
-      DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-				    sizeToDeal, numToDeal,
-				    dead, INNER_LOOP_OMAHA);
-    } else {
-      INNER_LOOP_OMAHA;
-    }
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_OMAHA));
   } else if (game == game_omaha8) {
-    if(totalToDeal > 0) {
-      DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-				    sizeToDeal, numToDeal,
-				    dead, INNER_LOOP_OMAHA8);
-    } else {
-      INNER_LOOP_OMAHA8;
-    }
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_OMAHA8));
   } else if (game == game_7stud) {
-    if(totalToDeal > 0) {
-      DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-				    sizeToDeal, numToDeal,
-				    dead, INNER_LOOP_ANY_HIGH);
-    } else {
-      INNER_LOOP_ANY_HIGH;
-    }
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_ANY_HIGH));
   } else if (game == game_7stud8) {
-    if(totalToDeal > 0) {
-      DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-				    sizeToDeal, numToDeal,
-				    dead, INNER_LOOP_ANY_HILO);
-    } else {
-      INNER_LOOP_ANY_HILO;
-    }
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_ANY_HILO));
   } else if (game == game_7studnsq) {
-    DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-                                  sizeToDeal, numToDeal,
-                                  dead, INNER_LOOP_7STUDNSQ);
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_7STUDNSQ));
   } else if (game == game_razz) {
-    DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-                                  sizeToDeal, numToDeal,
-                                  dead, INNER_LOOP_RAZZ);
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_RAZZ));
   } else if (game == game_lowball27) {
-    DECK_ENUMERATE_COMBINATIONS_D(StdDeck, cardsDealt,
-                                  sizeToDeal, numToDeal,
-                                  dead, INNER_LOOP_LOWBALL27);
+    RBENUM_ENUMERATE_PARTITION_D(INNER_LOOP_EXHAUSTIVE(INNER_LOOP_LOWBALL27));
   } else {
     return 1;
   }
 
-  result->game = game;
-  result->nplayers = sizeToDeal - 1;
-  result->sampleType = ENUM_EXHAUSTIVE;
   return 0;  
 }
 
+/*
+ * xorshift128+ random number generator. Each sampling thread owns one,
+ * seeded from the user supplied seed and the thread index, so that a
+ * given (seed, threads) pair always deals the same cards.
+ */
+typedef struct {
+  uint64_t s[2];
+} rbenum_rng_t;
+
+#define RBENUM_GOLDEN_GAMMA 0x9E3779B97F4A7C15ULL
+
+static uint64_t
+rbenumSplitMix64(uint64_t* x) {
+  uint64_t z = (*x += RBENUM_GOLDEN_GAMMA);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/*
+ * Stream n is seeded with the splitmix64 outputs 2n and 2n + 1 of seed.
+ */
+static void
+rbenumRngSeed(rbenum_rng_t* rng, uint64_t seed, int stream) {
+  uint64_t x = seed + 2 * (uint64_t)stream * RBENUM_GOLDEN_GAMMA;
+  rng->s[0] = rbenumSplitMix64(&x);
+  rng->s[1] = rbenumSplitMix64(&x);
+}
+
+static inline uint64_t
+rbenumRngNext(rbenum_rng_t* rng) {
+  uint64_t s1 = rng->s[0];
+  uint64_t s0 = rng->s[1];
+  rng->s[0] = s0;
+  s1 ^= s1 << 23;
+  rng->s[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+  return rng->s[1] + s0;
+}
+
+/*
+ * Uniform integer in [0, n)
+ */
+static inline int
+rbenumRngBelow(rbenum_rng_t* rng, int n) {
+  return (int)(((rbenumRngNext(rng) >> 32) * (uint64_t)n) >> 32);
+}
+
+/* RBENUM_MONTECARLO_PERMUTATIONS_D works like DECK_MONTECARLO_PERMUTATIONS_D
+   except that cards are drawn with rng instead of the library global
+   generator: num_iter times, each set_var[i] receives set_sizes[i] cards
+   picked uniformly among the cards not in dead_cards. The caller makes
+   sure there are enough live cards. */
+
+#define RBENUM_MONTECARLO_PERMUTATIONS_D(set_var, num_sets, set_sizes,	\
+					 dead_cards, num_iter, rng, action) \
+do {									\
+  int _live[StdDeck_N_CARDS];						\
+  int _nlive = 0;							\
+  int64_t _iter;							\
+  int _set, _k, _used;							\
+  for (_k = 0; _k < StdDeck_N_CARDS; _k++)				\
+    if (!StdDeck_CardMask_CARD_IS_SET(dead_cards, _k))			\
+      _live[_nlive++] = _k;						\
+  for (_iter = 0; _iter < (num_iter); _iter++) {			\
+    _used = 0;								\
+    for (_set = 0; _set < (num_sets); _set++) {				\
+      StdDeck_CardMask_RESET(set_var[_set]);				\
+      for (_k = 0; _k < (set_sizes)[_set]; _k++) {			\
+        int _pick = _used + rbenumRngBelow(rng, _nlive - _used);	\
+        int _card = _live[_pick];					\
+        _live[_pick] = _live[_used];					\
+        _live[_used++] = _card;						\
+        StdDeck_CardMask_SET(set_var[_set], _card);			\
+      }									\
+    }									\
+    { action }								\
+  }									\
+} while (0)
+
 static int 
 rbenumSample(enum_game_t game, StdDeck_CardMask pockets[],
 		 int numToDeal[],
                StdDeck_CardMask board, StdDeck_CardMask dead,
-               int sizeToDeal, int iterations, enum_result_t *result) {
+               int sizeToDeal, int64_t iterations, rbenum_result_t *result,
+               rbenum_rng_t *rng, volatile int *interrupted,
+               rbenum_progress_t *progress) {
+  int totalToDeal = 0;
+  int progress_next = progress != 0 ? progress->monitor->every : 0;
+  int weight = 1;
+  int hand7;
+  rbomaha_hole_t omahaHolesStorage[ENUM_MAXPLAYERS];
+  rbomaha_hole_t *omahaHoles = NULL;
+  int omahaBoard = 0;
   int i;
-  enumResultClear(result);
+  rbenumResultClear(result);
   StdDeck_CardMask cardsDealt[ENUM_MAXPLAYERS + 1];
   memset(cardsDealt, 0, sizeof(StdDeck_CardMask) * (ENUM_MAXPLAYERS + 1));
   if (sizeToDeal - 1 > ENUM_MAXPLAYERS)
     return 1;
+  result->game = game;
+  result->nplayers = sizeToDeal - 1;
+  result->sampleType = ENUM_SAMPLE;
+  for(i = 0; i < sizeToDeal; i++)
+    totalToDeal += numToDeal[i];
+  hand7 = rbHandTableFits(pockets, numToDeal, board, sizeToDeal);
+  if ((game == game_omaha || game == game_omaha8) &&
+      rbOmahaFits(pockets, numToDeal, board, sizeToDeal)) {
+    for(i = 0; i < sizeToDeal - 1; i++)
+      rbOmahaHoleInit(&omahaHolesStorage[i], pockets[i]);
+    omahaHoles = omahaHolesStorage;
+    omahaBoard = numToDeal[0];
+    for(i = 0; i < StdDeck_N_CARDS; i++)
+      if(StdDeck_CardMask_CARD_IS_SET(board, i))
+        omahaBoard++;
+  }
 
   /*
    * Cards in pockets or in the board must not be dealt 
@@ -389,79 +1753,187 @@ rbenumSample(enum_game_t game, StdDeck_CardMask pockets[],
     StdDeck_CardMask_OR(dead, dead, pockets[i]);
   }
 
+  {
+    int nlive = 0;
+    for(i = 0; i < StdDeck_N_CARDS; i++)
+      if(!StdDeck_CardMask_CARD_IS_SET(dead, i))
+        nlive++;
+    if(totalToDeal > nlive)
+      return 1;
+  }
+
   if (game == game_holdem) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_ANY_HIGH);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_ANY_HIGH);
   } else if (game == game_holdem8) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_ANY_HILO);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_HOLDEM8);
   } else if (game == game_omaha) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_OMAHA);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_OMAHA);
   } else if (game == game_omaha8) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_OMAHA8);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_OMAHA8);
   } else if (game == game_7stud) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_ANY_HIGH);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_ANY_HIGH);
   } else if (game == game_7stud8) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_ANY_HILO);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_ANY_HILO);
   } else if (game == game_7studnsq) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_7STUDNSQ);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_7STUDNSQ);
   } else if (game == game_razz) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_RAZZ);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_RAZZ);
   } else if (game == game_lowball27) {
-    DECK_MONTECARLO_PERMUTATIONS_D(StdDeck, cardsDealt,
-				   sizeToDeal, numToDeal,
-				   dead, iterations, INNER_LOOP_LOWBALL27);
+    RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				     sizeToDeal, numToDeal,
+				     dead, iterations, rng, INNER_LOOP_LOWBALL27);
   } else {
     return 1;
   }
 
-  result->game = game;
-  result->nplayers = sizeToDeal - 1;
-  result->sampleType = ENUM_SAMPLE;
   return 0;  
 }
 
+/*
+ * Add the counts of from to result, as if both enumerations had been
+ * done by the same rbenum* call.
+ */
+static void
+rbenumResultMerge(rbenum_result_t *result, rbenum_result_t *from) {
+  unsigned int i;
+
+  for(i = 0; i < from->nplayers; i++) {
+    rbenum_player_t *to = &result->players[i];
+    rbenum_player_t *counts = &from->players[i];
+    to->nwinhi += counts->nwinhi;
+    to->ntiehi += counts->ntiehi;
+    to->nlosehi += counts->nlosehi;
+    to->nwinlo += counts->nwinlo;
+    to->ntielo += counts->ntielo;
+    to->nloselo += counts->nloselo;
+    to->nscoop += counts->nscoop;
+    to->ev += counts->ev;
+  }
+  result->nsamples += from->nsamples;
+  result->game = from->game;
+  result->nplayers = from->nplayers;
+  result->sampleType = from->sampleType;
+}
+
+/*
+ * Divide the counts of result by n, which all of them are multiples of.
+ */
+static void
+rbenumResultDivide(rbenum_result_t *result, uint64_t n) {
+  unsigned int i;
+
+  for(i = 0; i < result->nplayers; i++) {
+    rbenum_player_t *counts = &result->players[i];
+    counts->nwinhi /= n;
+    counts->ntiehi /= n;
+    counts->nlosehi /= n;
+    counts->nwinlo /= n;
+    counts->ntielo /= n;
+    counts->nloselo /= n;
+    counts->nscoop /= n;
+    counts->ev /= n;
+  }
+  result->nsamples /= n;
+}
+
 #define NOCARD 255
 
+/*
+ * A list of cards is either an array whose entries are card names
+ * ("As", "__" for an unknown card) or card indices (0 to 51 as
+ * returned by eval_hand, NOCARD for an unknown card), or a single
+ * integer whose bit n is set when card index n is in the list. The
+ * integer forms are not parsed at all and can hold no unknown card.
+ */
+static int rbCardListIsMask(VALUE object)
+{
+  return FIXNUM_P(object) || TYPE(object) == T_BIGNUM;
+}
+
+static uint64_t rbCardListMask(VALUE object)
+{
+  uint64_t mask = NUM2ULL(object);
+
+  if(mask >> StdDeck_N_CARDS)
+    rb_raise(rb_eArgError, "card mask 0x%llx has bits beyond the last card", (unsigned long long)mask);
+
+  return mask;
+}
+
+/*
+ * Number of cards, known or not, in the list
+ */
+static int rbCardListSize(VALUE object)
+{
+  if(rbCardListIsMask(object))
+    return __builtin_popcountll(rbCardListMask(object));
+  if (TYPE(object) != T_ARRAY)
+    rb_fatal("expected a list of cards");
+  return RARRAY_LENINT(object);
+}
+
 static int rbList2CardMask(VALUE object, CardMask* cardsp)
 {
   CardMask cards;
   int cards_size = 0;
   int valid_cards_size = 0;
 
+  CardMask_RESET(cards);
+
+  if(rbCardListIsMask(object)) {
+    uint64_t mask = rbCardListMask(object);
+
+    for(; mask; mask &= mask - 1) {
+      CardMask_SET(cards, __builtin_ctzll(mask));
+      valid_cards_size++;
+    }
+    *cardsp = cards;
+    return valid_cards_size;
+  }
+
   if (TYPE(object) != T_ARRAY)
   {
     rb_fatal("expected a list of cards");
   }
 
   valid_cards_size = cards_size = RARRAY_LENINT(object);
-  CardMask_RESET(cards);
 
   int card;
   int i;
   for(i = 0; i < cards_size; i++) {
+    VALUE entry = rb_ary_entry(object, i);
     card = -1;
-    char* card_string = RSTRING_PTR(rb_ary_entry(object, i));
 
-    if(!strcmp(card_string, "__"))
-        card = 255;
-    else
+    if(FIXNUM_P(entry)) {
+      long index = FIX2LONG(entry);
+      if((index < 0 || index >= StdDeck_N_CARDS) && index != NOCARD)
+        rb_raise(rb_eArgError, "card %ld is not a valid card index", index);
+      card = (int)index;
+    } else {
+      char* card_string = StringValueCStr(entry);
+
+      if(!strcmp(card_string, "__"))
+        card = NOCARD;
+      else
         if(Deck_stringToCard(card_string, &card) == 0)
-            rb_fatal("card %s is not a valid card name", card_string);
+          rb_fatal("card %s is not a valid card name", card_string);
+    }
 
     if(card == NOCARD)
       valid_cards_size--;
@@ -474,11 +1946,13 @@ static int rbList2CardMask(VALUE object, CardMask* cardsp)
   return valid_cards_size;
 }
 
+/*
+ * handval is the value of the five cards of hand
+ */
 static VALUE
-CardMask2SortedRbList(CardMask hand, int low)
+CardMask2SortedRbList(CardMask hand, HandVal handval, int low)
 {
   int i;
-  HandVal handval;
   VALUE result = rb_ary_new();
 
   if(StdDeck_CardMask_IS_EMPTY(hand)) {
@@ -486,12 +1960,6 @@ CardMask2SortedRbList(CardMask hand, int low)
     return result;
   }
 
-  if(low) {
-    handval = Hand_EVAL_LOW8(hand, 5);
-  } else {
-    handval = Hand_EVAL_N(hand, 5);
-  }
-
   int htype = HandVal_HANDTYPE(handval);
   {
     rb_ary_push(result, rb_str_new2(StdRules_handTypeNames[htype]));
@@ -613,6 +2081,82 @@ int findanddelete(CardMask* hand, int rank)
   return -1;
 }
 
+/*
+ * The five cards of hand that make handval, the value of the whole hand
+ * as given by Hand_EVAL_N or, if low is set, Hand_EVAL_LOW8. The ranks
+ * of the five cards are those of handval and, where the hand holds more
+ * cards of a rank than it uses, the highest suits are picked, which are
+ * the cards a brute force enumeration of the 5 card subsets keeps.
+ */
+static CardMask
+rbBestFive(CardMask hand, HandVal handval, int low)
+{
+  CardMask best;
+  int htype = HandVal_HANDTYPE(handval);
+  int nsig = StdRules_nSigCards[htype];
+  int ranks[5];
+  int counts[5] = { 1, 1, 1, 1, 1 };
+  int i, j;
+
+  StdDeck_CardMask_RESET(best);
+  if(low && handval == LowHandVal_NOTHING)
+    return best;
+
+  ranks[0] = HandVal_TOP_CARD(handval);
+  ranks[1] = HandVal_SECOND_CARD(handval);
+  ranks[2] = HandVal_THIRD_CARD(handval);
+  ranks[3] = HandVal_FOURTH_CARD(handval);
+  ranks[4] = HandVal_FIFTH_CARD(handval);
+  if(low) {
+    for(i = 0; i < 5; i++)
+      ranks[i] = LOWRANK2RANK(ranks[i]);
+  } else if(htype == HandType_STRAIGHT || htype == HandType_STFLUSH) {
+    int top = ranks[0];
+
+    for(i = 0; i < 5; i++)
+      ranks[i] = top - i < 0 ? StdDeck_Rank_ACE : top - i;
+    nsig = 5;
+  }
+
+  if(!low && (htype == HandType_FLUSH || htype == HandType_STFLUSH)) {
+    int suit;
+
+    for(suit = StdDeck_Suit_LAST; suit > StdDeck_Suit_FIRST; suit--) {
+      for(i = 0; i < 5 && StdDeck_CardMask_CARD_IS_SET(hand, StdDeck_MAKE_CARD(ranks[i], suit)); i++)
+        ;
+      if(i == 5)
+        break;
+    }
+    for(i = 0; i < 5; i++)
+      StdDeck_CardMask_SET(best, StdDeck_MAKE_CARD(ranks[i], suit));
+    return best;
+  }
+
+  switch(htype) {
+  case HandType_ONEPAIR:
+  case HandType_TWOPAIR:
+    counts[0] = 2;
+    break;
+  case HandType_TRIPS:
+  case HandType_FULLHOUSE:
+    counts[0] = 3;
+    break;
+  case HandType_QUADS:
+    counts[0] = 4;
+    break;
+  }
+  if(htype == HandType_TWOPAIR || htype == HandType_FULLHOUSE)
+    counts[1] = 2;
+
+  for(i = 0; i < nsig; i++)
+    for(j = 0; j < counts[i]; j++) {
+      int card = findanddelete(&hand, ranks[i]);
+      StdDeck_CardMask_SET(best, card);
+    }
+
+  return best;
+}
+
 static int
 OmahaHiLow8_Best(StdDeck_CardMask hole, StdDeck_CardMask board,
 		 HandVal *hival, LowHandVal *loval,
@@ -702,39 +2246,20 @@ OmahaHiLow8_Best(StdDeck_CardMask hole, StdDeck_CardMask board,
   return 0;
 }
 
+/*
+ * The eval_hand result of hand, alone or, when board_size is not 0,
+ * played by omaha rules with board.
+ */
 static VALUE
-t_eval_hand(VALUE self, VALUE args)
+rbEvalHand(CardMask hand, CardMask board, int board_size, int low)
 {
   VALUE result = 0;
-  VALUE rbboard = 0;
-  VALUE rbhand = 0;
-  char* hilow_string = 0;
-
-  hilow_string = RSTRING_PTR(rb_hash_aref(args, rb_str_new2("side")));
-  rbboard = rb_hash_aref(args, rb_str_new2("board"));
-  rbhand = rb_hash_aref(args, rb_str_new2("hand"));
-
-  int low = 0;
-  CardMask hand;
-  CardMask board;
-  int board_size = 0;
   CardMask best;
   HandVal best_handval;
+  int ncards = __builtin_popcountll(hand.cards_n);
 
   StdDeck_CardMask_RESET(best);
 
-  if(!strcmp(hilow_string, "low")) {
-    low = 1;
-  }
-
-  if(rbList2CardMask(rbhand, &hand) < 0)
-    rb_fatal("empty hand given");
-
-  if( !NIL_P(rbboard))
-  {
-    board_size = rbList2CardMask(rbboard, &board);
-  }
-
   if(board_size > 0) {
     CardMask hicards;
     CardMask locards;
@@ -751,38 +2276,17 @@ t_eval_hand(VALUE self, VALUE args)
       best = hicards;
       best_handval = hival;
     }
-  } else {
-    CardMask cards;
-    CardMask dead;
-
-    StdDeck_CardMask_RESET(best);
-
-    StdDeck_CardMask_RESET(dead);
-    StdDeck_CardMask_OR(dead, dead, hand);
-    StdDeck_CardMask_NOT(dead, dead);
-
+  } else if(ncards >= 5) {
+    /*
+     * Evaluate the whole hand once and find the five cards that make
+     * its value rather than evaluating every 5 card subset
+     */
     if(low) {
-      best_handval = LowHandVal_NOTHING;
+      best_handval = Hand_EVAL_LOW8(hand, ncards);
     } else {
-      best_handval = HandVal_NOTHING;
-    }
-
-    ENUMERATE_N_CARDS_D(cards, 5, dead, 
-    {
-      HandVal handval;
-
-      if(low) {
-	handval = Hand_EVAL_LOW8(cards, 5);
-      } else {
-	handval = Hand_EVAL_N(cards, 5);
-      }
-
-      if(low ? (handval < best_handval) : (handval > best_handval)) {
-	best = cards;
-	best_handval = handval;
-      }
+      best_handval = Hand_EVAL_N(hand, ncards);
     }
-			);
+    best = rbBestFive(hand, best_handval, low);
   }
 
   if(StdDeck_CardMask_IS_EMPTY(best)) {
@@ -791,41 +2295,329 @@ t_eval_hand(VALUE self, VALUE args)
 
   result = rb_hash_new();
   rb_hash_aset(result, rb_str_new2("value"), INT2NUM(best_handval));
-  rb_hash_aset(result, rb_str_new2("combination"), CardMask2SortedRbList(best, low));
+  rb_hash_aset(result, rb_str_new2("combination"), CardMask2SortedRbList(best, best_handval, low));
 
   return result;
 }
 
 static VALUE
-t_eval(VALUE self, VALUE args)
+t_eval_hand(VALUE self, VALUE args)
 {
-  int i;
-  int pockets_size;
-  int iterations = 0;
-  VALUE rbpockets = 0;
   VALUE rbboard = 0;
-  VALUE rbdead = 0;
-  VALUE rbiterations = 0;
-  char* game = 0;
-  enum_gameparams_t* params = 0;
+  VALUE rbhand = 0;
+  char* hilow_string = 0;
 
-  game = RSTRING_PTR(rb_hash_aref(args, rb_str_new2("game")));
-  rbpockets = rb_hash_aref(args, rb_str_new2("pockets"));
+  hilow_string = RSTRING_PTR(rb_hash_aref(args, rb_str_new2("side")));
   rbboard = rb_hash_aref(args, rb_str_new2("board"));
-  rbdead = rb_hash_aref(args, rb_str_new2("dead"));
-  rbiterations = rb_hash_aref(args, rb_str_new2("iterations"));
+  rbhand = rb_hash_aref(args, rb_str_new2("hand"));
 
-  if( !NIL_P(rbiterations))
+  int low = 0;
+  CardMask hand;
+  CardMask board;
+  int board_size = 0;
+
+  if(!strcmp(hilow_string, "low")) {
+    low = 1;
+  }
+
+  if(rbList2CardMask(rbhand, &hand) < 0)
+    rb_fatal("empty hand given");
+
+  if( !NIL_P(rbboard))
   {
-    iterations = FIX2INT(rbiterations);
+    board_size = rbList2CardMask(rbboard, &board);
   }
 
-  StdDeck_CardMask pockets[ENUM_MAXPLAYERS];
-  int numToDeal[ENUM_MAXPLAYERS];
-  CardMask dead_cards;
-  CardMask board_cards;
+  return rbEvalHand(hand, board, board_size, low);
+}
 
+/*
+ * eval_hand of every hand of args["hands"], with the side and board of
+ * args parsed once for all of them.
+ */
+static VALUE
+t_eval_hand_many(VALUE self, VALUE args)
+{
+  VALUE rbboard = 0;
+  VALUE rbhands = 0;
   VALUE result = 0;
+  char* hilow_string = 0;
+  int low = 0;
+  CardMask board;
+  int board_size = 0;
+  int i;
+
+  hilow_string = RSTRING_PTR(rb_hash_aref(args, rb_str_new2("side")));
+  rbboard = rb_hash_aref(args, rb_str_new2("board"));
+  rbhands = rb_hash_aref(args, rb_str_new2("hands"));
+
+  if(!strcmp(hilow_string, "low")) {
+    low = 1;
+  }
+
+  if (TYPE(rbhands) != T_ARRAY)
+    rb_raise(rb_eArgError, "hands must be list");
+
+  if( !NIL_P(rbboard))
+  {
+    board_size = rbList2CardMask(rbboard, &board);
+  }
+
+  result = rb_ary_new2(RARRAY_LEN(rbhands));
+  for(i = 0; i < RARRAY_LENINT(rbhands); i++) {
+    CardMask hand;
+
+    if(rbList2CardMask(rb_ary_entry(rbhands, i), &hand) < 0)
+      rb_raise(rb_eArgError, "empty hand given");
+    rb_ary_push(result, rbEvalHand(hand, board, board_size, low));
+  }
+
+  return result;
+}
+
+/*
+ * Cache key: a scenario with its suits renamed and its pockets reordered
+ * so that every scenario equivalent to it up to a permutation of suits
+ * and players has the same key. Sampled scenarios are only cached when
+ * they are reproducible (explicit seed) and are not normalized since
+ * renaming suits would change the cards dealt.
+ */
+typedef struct {
+  int game;
+  int64_t iterations;
+  uint64_t seed;
+  int threads;
+  int pockets_size;
+  int numToDeal[ENUM_MAXPLAYERS + 1];
+  StdDeck_CardMask pockets[ENUM_MAXPLAYERS];
+  StdDeck_CardMask board;
+  StdDeck_CardMask dead;
+} rbcache_key_t;
+
+/*
+ * The counts of a rbenum_result_t, players in key order.
+ */
+typedef struct {
+  uint64_t nsamples;
+  rbenum_player_t players[ENUM_MAXPLAYERS];
+} rbcache_value_t;
+
+typedef struct rbcache_entry_s {
+  rbcache_key_t key;
+  uint64_t hash;
+  rbcache_value_t value;
+  struct rbcache_entry_s* next;
+  struct rbcache_entry_s* newer;
+  struct rbcache_entry_s* older;
+} rbcache_entry_t;
+
+/*
+ * LRU cache of enumeration results, disabled until PokerEval.cache_size
+ * is set. It is only ever used with the GVL held.
+ */
+typedef struct {
+  int capacity;
+  int size;
+  int nbuckets;
+  rbcache_entry_t** buckets;
+  rbcache_entry_t* newest;
+  rbcache_entry_t* oldest;
+  unsigned long hits;
+  unsigned long misses;
+} rbcache_t;
+
+static rbcache_t rbcache;
+
+/*
+ * Equity distribution over the runouts of an intermediate street: the
+ * equity of each player on every runout, over the cards dealt after it,
+ * is counted in one of nbuckets buckets of equal width and its square
+ * is summed for the expected hand strength squared.
+ */
+#define RBEVAL_HISTOGRAM_MAXBUCKETS 100
+
+typedef struct {
+  uint64_t nrunouts;
+  uint64_t counts[ENUM_MAXPLAYERS][RBEVAL_HISTOGRAM_MAXBUCKETS];
+  double sumsq[ENUM_MAXPLAYERS];
+} rbeval_histogram_t;
+
+/*
+ * A board has at most 5 cards, revealed at most at 6 points from 0 to 5
+ * cards.
+ */
+#define RBEVAL_MAXSTREETS 6
+
+/*
+ * Everything t_eval needs to run an enumeration, parsed from the Ruby
+ * arguments up front so that the enumeration itself never touches a
+ * Ruby object and can run without the GVL.
+ */
+typedef struct {
+  enum_gameparams_t* params;
+  StdDeck_CardMask pockets[ENUM_MAXPLAYERS];
+  int numToDeal[ENUM_MAXPLAYERS + 1];
+  StdDeck_CardMask board;
+  StdDeck_CardMask dead;
+  int pockets_size;
+  int64_t iterations;
+  uint64_t seed;
+  int seeded;
+  int threads;
+  int canonical;
+  double target_stderr;
+  int64_t min_iterations;
+  double achieved_stderr;
+  int deadline_ms;
+  int partial;
+  double elapsed;
+  int progress_every;
+  int compact;
+  int histogram_buckets;
+  int histogram_street;
+  rbeval_histogram_t histogram;
+  int nstreets;
+  int streets[RBEVAL_MAXSTREETS];
+  StdDeck_CardMask street_cards[RBEVAL_MAXSTREETS];
+  rbenum_result_t street_results[RBEVAL_MAXSTREETS];
+  rbenum_monitor_t* monitor;
+  struct rbeval_worker_s* workers;
+  volatile int interrupted;
+  int err;
+  rbenum_result_t result;
+  int cached;
+  int cache_keyed;
+  rbcache_key_t cache_key;
+  int cache_order[ENUM_MAXPLAYERS];
+} rbeval_job_t;
+
+/*
+ * One share of an enumeration split over job->threads threads: every
+ * job->threads-th runout of an exhaustive enumeration, or its part of the
+ * iterations of a sampling drawn from its own random stream.
+ */
+typedef struct rbeval_worker_s {
+  rbeval_job_t* job;
+  int partition;
+  int64_t iterations;
+  rbenum_rng_t rng;
+  int started;
+  pthread_t thread;
+  int err;
+  rbenum_result_t result;
+  rbenum_progress_t progress;
+  rbenum_result_t total;
+  int nblocks;
+  double sum[ENUM_MAXPLAYERS];
+  double sumsq[ENUM_MAXPLAYERS];
+  rbeval_histogram_t histogram;
+  rbenum_result_t streets[RBEVAL_MAXSTREETS];
+} rbeval_worker_t;
+
+#define RBEVAL_MAXTHREADS 256
+
+/*
+ * Adaptive sampling draws blocks of RBEVAL_ADAPTIVE_BLOCK samples,
+ * RBEVAL_ADAPTIVE_ROUND blocks per thread between two checks of the
+ * standard error, which is estimated from the spread of the block means.
+ */
+#define RBEVAL_ADAPTIVE_BLOCK 1000
+#define RBEVAL_ADAPTIVE_ROUND 8
+#define RBEVAL_ADAPTIVE_MIN_ITERATIONS 10000
+#define RBEVAL_ADAPTIVE_MAX_ITERATIONS 10000000
+
+/*
+ * job->interrupted is set to RBEVAL_EXPIRED when the deadline of a job
+ * is reached, which stops it like a Ruby interrupt does, except that
+ * what was computed so far is kept.
+ */
+#define RBEVAL_EXPIRED 2
+
+/*
+ * Same as RBEVAL_EXPIRED, when the block given to t_eval asked to stop.
+ */
+#define RBEVAL_STOPPED 3
+#define RBEVAL_PROGRESS_EVERY 100000
+
+/*
+ * Nanoseconds one thread takes to evaluate one player's hand, per game,
+ * measured on completed evaluations. Used to tell whether an exhaustive
+ * enumeration can finish before its deadline.
+ */
+#define RBEVAL_DEFAULT_HAND_NS 100.0
+static double rbeval_hand_ns[game_NUMGAMES];
+
+/*
+ * Keys of the t_eval argument hash, allocated once by Init_poker_eval_api
+ * rather than on every call.
+ */
+static VALUE rbkey_game;
+static VALUE rbkey_pockets;
+static VALUE rbkey_board;
+static VALUE rbkey_dead;
+static VALUE rbkey_iterations;
+static VALUE rbkey_threads;
+static VALUE rbkey_seed;
+static VALUE rbkey_canonical;
+static VALUE rbkey_stderr;
+static VALUE rbkey_min_iterations;
+static VALUE rbkey_max_iterations;
+static VALUE rbkey_deadline_ms;
+static VALUE rbkey_progress_every;
+static VALUE rbkey_compact;
+static VALUE rbkey_histogram;
+static VALUE rbkey_histogram_street;
+static VALUE rbkey_streets;
+
+/*
+ * Keys of the t_eval result hash
+ */
+static VALUE rbkey_info;
+static VALUE rbkey_eval;
+static VALUE rbkey_samples;
+static VALUE rbkey_haslopot;
+static VALUE rbkey_hashipot;
+static VALUE rbkey_partial;
+static VALUE rbkey_scoop;
+static VALUE rbkey_winhi;
+static VALUE rbkey_losehi;
+static VALUE rbkey_tiehi;
+static VALUE rbkey_winlo;
+static VALUE rbkey_loselo;
+static VALUE rbkey_tielo;
+static VALUE rbkey_ev;
+static VALUE rbkey_runouts;
+static VALUE rbkey_ehs2;
+static VALUE rbkey_exact;
+
+/*
+ * Keys of the t_showdown arguments and result
+ */
+static VALUE rbkey_showdowns;
+static VALUE rbkey_hi;
+static VALUE rbkey_low;
+static VALUE rbkey_hival;
+static VALUE rbkey_loval;
+
+/*
+ * Keys of the PokerEval.cache_stats result
+ */
+static VALUE rbkey_capacity;
+static VALUE rbkey_entries;
+static VALUE rbkey_hits;
+static VALUE rbkey_misses;
+
+static void
+rbInternKey(VALUE* key, const char* name)
+{
+  *key = rb_obj_freeze(rb_str_new2(name));
+  rb_global_variable(key);
+}
+
+static enum_gameparams_t*
+rbGameParams(char* game)
+{
+  enum_gameparams_t* params = 0;
 
   if(!strcmp(game, "holdem")) {
     params = enumGameParams(game_holdem);
@@ -858,100 +2650,3572 @@ t_eval(VALUE self, VALUE args)
   if(params == 0)
     rb_fatal("game %s is not a valid value (holdem, holdem8, omaha, omaha8, 7stud, 7stud8, 7studnsq, razz, 5draw, 5draw8, 5drawnsq, lowball, lowball27)", game);
 
-  if (TYPE(rbpockets) != T_ARRAY)
-    rb_fatal("pockets must be list");
+  return params;
+}
 
-  pockets_size = RARRAY_LENINT(rbpockets);
+static int
+rbEvalBoard2Job(VALUE rbboard, rbeval_job_t* job)
+{
+  int count;
 
-  {
-    for(i = 0; i < pockets_size; i++) {
-      int count;
-      CardMask_RESET(pockets[i]);
-      VALUE rbpocket = rb_ary_entry(rbpockets, i);
+  count = rbList2CardMask(rbboard, &job->board);
+  if(count < 0)
+    return 0;
+  if(count < rbCardListSize(rbboard))
+    job->numToDeal[0] = rbCardListSize(rbboard) - count;
+  else
+    job->numToDeal[0] = 0;
 
-      count = rbList2CardMask(rbpocket, &pockets[i]);
+  return 1;
+}
 
-      if(count < 0)
-        goto err;
-      if(count < RARRAY_LEN(rbpocket))
-        numToDeal[i + 1] = RARRAY_LENINT(rbpocket) - count;
-      else
-        numToDeal[i + 1] = 0;
+static void
+rbEvalDead2Job(VALUE rbdead, rbeval_job_t* job)
+{
+  if(!NIL_P(rbdead) && rbCardListSize(rbdead) > 0) {
+    if(rbList2CardMask(rbdead, &job->dead) < 0){
+      rb_fatal("dead cards error");
     }
   }
+  else {
+      CardMask_RESET(job->dead);
+  }
+}
+
+/*
+ * Fill job from the t_eval argument hash. Returns 0 if a pocket or the
+ * board could not be parsed.
+ */
+static int
+rbEvalArgs2Job(VALUE args, rbeval_job_t* job)
+{
+  int i;
+  VALUE rbpockets = 0;
+  VALUE rbboard = 0;
+  VALUE rbdead = 0;
+  VALUE rbiterations = 0;
+  VALUE rbthreads = 0;
+  VALUE rbseed = 0;
+
+  memset(job, '\0', sizeof(rbeval_job_t));
+
+  job->params = rbGameParams(RSTRING_PTR(rb_hash_aref(args, rbkey_game)));
+  rbpockets = rb_hash_aref(args, rbkey_pockets);
+  rbboard = rb_hash_aref(args, rbkey_board);
+  rbdead = rb_hash_aref(args, rbkey_dead);
+  rbiterations = rb_hash_aref(args, rbkey_iterations);
+  rbthreads = rb_hash_aref(args, rbkey_threads);
+  rbseed = rb_hash_aref(args, rbkey_seed);
 
+  if( !NIL_P(rbiterations))
+  {
+    job->iterations = NUM2LL(rbiterations);
+  }
 
+  job->threads = 1;
+  if( !NIL_P(rbthreads))
   {
-    int count;
-    count = rbList2CardMask(rbboard, &board_cards);
-    if(count < 0)
-      goto err;
-    if(count < RARRAY_LENINT(rbboard))
-      numToDeal[0] = RARRAY_LENINT(rbboard) - count;
-    else
-      numToDeal[0] = 0;
+    job->threads = NUM2INT(rbthreads);
+    if(job->threads < 1 || job->threads > RBEVAL_MAXTHREADS)
+      rb_raise(rb_eArgError, "threads must be between 1 and %d", RBEVAL_MAXTHREADS);
   }
 
-  if(!NIL_P(rbdead) && RARRAY_LEN(rbdead) > 0) {
-    if(rbList2CardMask(rbdead, &dead_cards) < 0){
-      rb_fatal("dead cards error");
-    }
+  job->canonical = RTEST(rb_hash_aref(args, rbkey_canonical));
+
+  /*
+   * stderr turns sampling adaptive: iterations is then ignored and
+   * sampling goes on until the standard error of every player's ev, in
+   * the units of ev, is at most stderr.
+   */
+  if( !NIL_P(rb_hash_aref(args, rbkey_stderr)))
+  {
+    VALUE rbmin = rb_hash_aref(args, rbkey_min_iterations);
+    VALUE rbmax = rb_hash_aref(args, rbkey_max_iterations);
+
+    job->target_stderr = NUM2DBL(rb_hash_aref(args, rbkey_stderr));
+    if(!(job->target_stderr > 0))
+      rb_raise(rb_eArgError, "stderr must be positive");
+    job->min_iterations = NIL_P(rbmin) ? RBEVAL_ADAPTIVE_MIN_ITERATIONS : NUM2LL(rbmin);
+    job->iterations = NIL_P(rbmax) ? RBEVAL_ADAPTIVE_MAX_ITERATIONS : NUM2LL(rbmax);
+    if(job->iterations < 1 || job->min_iterations > job->iterations)
+      rb_raise(rb_eArgError, "max_iterations must be positive and at least min_iterations");
   }
-  else {
-      CardMask_RESET(dead_cards);
+
+  /*
+   * deadline_ms bounds the time the evaluation runs: sampling stops when
+   * it is reached and an exhaustive enumeration that does not finish in
+   * time samples instead (see rbeval_run_deadline). Results that are not
+   * exhaustive have info["partial"] set to 1.
+   */
+  if( !NIL_P(rb_hash_aref(args, rbkey_deadline_ms)))
+  {
+    job->deadline_ms = NUM2INT(rb_hash_aref(args, rbkey_deadline_ms));
+    if(job->deadline_ms < 1)
+      rb_raise(rb_eArgError, "deadline_ms must be positive");
   }
 
+  job->progress_every = RBEVAL_PROGRESS_EVERY;
+  if( !NIL_P(rb_hash_aref(args, rbkey_progress_every)))
   {
-    enum_result_t cresult;
-    int err;
-    memset(&cresult, '\0', sizeof(enum_result_t));
+    job->progress_every = NUM2INT(rb_hash_aref(args, rbkey_progress_every));
+    if(job->progress_every < 1)
+      rb_raise(rb_eArgError, "progress_every must be positive");
+  }
 
-    if(iterations > 0) {
-      err = rbenumSample(params->game, pockets, numToDeal, board_cards, dead_cards, pockets_size + 1, iterations, &cresult);
-    } else {
-      err = rbenumExhaustive(params->game, pockets, numToDeal, board_cards, dead_cards, pockets_size + 1, &cresult);
-    }
-    if(err != 0) {
-      rb_fatal("poker-eval: rbenum returned error code %d", err);
-    }
+  job->compact = RTEST(rb_hash_aref(args, rbkey_compact));
 
-    result = rb_hash_new();
+  /*
+   * histogram => buckets records the equity distribution of every player
+   * over the runouts of the board up to histogram_street cards, the
+   * complete board by default. iterations is then the number of runouts
+   * sampled, the cards dealt after each of them being enumerated.
+   */
+  if( !NIL_P(rb_hash_aref(args, rbkey_histogram)))
+  {
+    VALUE rbstreet = rb_hash_aref(args, rbkey_histogram_street);
 
-    VALUE info = rb_hash_new(); 
-    rb_hash_aset(info, rb_str_new2("samples"), INT2NUM(cresult.nsamples));
-    rb_hash_aset(info, rb_str_new2("haslopot"), INT2NUM(params->haslopot));
-    rb_hash_aset(info, rb_str_new2("hashipot"), INT2NUM(params->hashipot));
+    job->histogram_buckets = NUM2INT(rb_hash_aref(args, rbkey_histogram));
+    if(job->histogram_buckets < 1 || job->histogram_buckets > RBEVAL_HISTOGRAM_MAXBUCKETS)
+      rb_raise(rb_eArgError, "histogram must be between 1 and %d", RBEVAL_HISTOGRAM_MAXBUCKETS);
+    if(job->target_stderr > 0 || job->deadline_ms > 0 || job->compact)
+      rb_raise(rb_eArgError, "histogram cannot be combined with stderr, deadline_ms or compact");
+    job->histogram_street = NIL_P(rbstreet) ? -1 : NUM2INT(rbstreet);
+  }
 
-    rb_hash_aset(result, rb_str_new2("info"), info);
+  if( !NIL_P(rbseed))
+  {
+    job->seed = NUM2ULL(rbseed);
+    job->seeded = 1;
+  }
+  else
+  {
+    job->seed = ((uint64_t)rb_genrand_int32() << 32) | rb_genrand_int32();
+  }
 
-    VALUE list = rb_ary_new();
-    for(i = 0; i < pockets_size; i++) {
-      VALUE tmp = rb_hash_new(); 
-      rb_hash_aset(tmp, rb_str_new2("scoop"), INT2NUM(cresult.nscoop[i]));
-      rb_hash_aset(tmp, rb_str_new2("winhi"), INT2NUM(cresult.nwinhi[i]));
-      rb_hash_aset(tmp, rb_str_new2("losehi"), INT2NUM(cresult.nlosehi[i]));
-      rb_hash_aset(tmp, rb_str_new2("tiehi"), INT2NUM(cresult.ntiehi[i]));
-      rb_hash_aset(tmp, rb_str_new2("winlo"), INT2NUM(cresult.nwinlo[i]));
-      rb_hash_aset(tmp, rb_str_new2("loselo"), INT2NUM(cresult.nloselo[i]));
-      rb_hash_aset(tmp, rb_str_new2("tielo"), INT2NUM(cresult.ntielo[i]));
-      rb_hash_aset(tmp, rb_str_new2("ev"), INT2NUM((cresult.ev[i] / cresult.nsamples) * 1000));
-      rb_ary_push(list, tmp);
-      tmp = 0;
-    }
-    rb_hash_aset(result, rb_str_new2("eval"), list);
+  if (TYPE(rbpockets) != T_ARRAY)
+    rb_fatal("pockets must be list");
+
+  job->pockets_size = RARRAY_LENINT(rbpockets);
+
+  if(job->pockets_size > ENUM_MAXPLAYERS)
+    rb_fatal("at most %d pockets are allowed", ENUM_MAXPLAYERS);
+
+  for(i = 0; i < job->pockets_size; i++) {
+    int count;
+    VALUE rbpocket = rb_ary_entry(rbpockets, i);
+
+    count = rbList2CardMask(rbpocket, &job->pockets[i]);
+
+    if(count < 0)
+      return 0;
+    if(count < rbCardListSize(rbpocket))
+      job->numToDeal[i + 1] = rbCardListSize(rbpocket) - count;
+    else
+      job->numToDeal[i + 1] = 0;
   }
 
-err:
+  if(!rbEvalBoard2Job(rbboard, job))
+    return 0;
+
+  rbEvalDead2Job(rbdead, job);
+
+  return 1;
+}
+
+static int rbcache_perms[24][StdDeck_Suit_COUNT];
+
+static void
+rbCacheInitPerms(void)
+{
+  int n = 0;
+  int a, b, c, d;
+
+  for(a = 0; a < 4; a++)
+    for(b = 0; b < 4; b++)
+      for(c = 0; c < 4; c++)
+        for(d = 0; d < 4; d++)
+          if(a != b && a != c && a != d && b != c && b != d && c != d) {
+            rbcache_perms[n][0] = a;
+            rbcache_perms[n][1] = b;
+            rbcache_perms[n][2] = c;
+            rbcache_perms[n][3] = d;
+            n++;
+          }
+}
+
+/*
+ * Rename the suits of cards: suit s becomes perm[s].
+ */
+static StdDeck_CardMask
+rbPermuteSuits(StdDeck_CardMask cards, const int perm[])
+{
+  StdDeck_CardMask result;
+  unsigned int ranks[StdDeck_Suit_COUNT];
+  int suit;
+
+  for(suit = StdDeck_Suit_FIRST; suit <= StdDeck_Suit_LAST; suit++)
+    ranks[perm[suit]] = rbenumSuitRanks(cards, suit);
+
+  StdDeck_CardMask_RESET(result);
+  StdDeck_CardMask_SET_HEARTS(result, ranks[StdDeck_Suit_HEARTS]);
+  StdDeck_CardMask_SET_DIAMONDS(result, ranks[StdDeck_Suit_DIAMONDS]);
+  StdDeck_CardMask_SET_CLUBS(result, ranks[StdDeck_Suit_CLUBS]);
+  StdDeck_CardMask_SET_SPADES(result, ranks[StdDeck_Suit_SPADES]);
+
   return result;
 }
 
-VALUE cPokerEval;
+/*
+ * Fill key with the canonical form of the job and order with the index,
+ * in the job, of the pocket at each position of the key.
+ */
+static void
+rbCacheKey(rbeval_job_t* job, rbcache_key_t* key, int order[])
+{
+  rbcache_key_t candidate;
+  int candidate_order[ENUM_MAXPLAYERS];
+  int nperms = job->iterations > 0 ? 1 : 24;
+  int p, i, j;
 
-void
-Init_poker_eval_api()
+  for(p = 0; p < nperms; p++) {
+    memset(&candidate, '\0', sizeof(rbcache_key_t));
+    candidate.game = job->params->game;
+    candidate.pockets_size = job->pockets_size;
+    candidate.numToDeal[0] = job->numToDeal[0];
+    if(job->iterations > 0) {
+      candidate.iterations = job->iterations;
+      candidate.seed = job->seed;
+      candidate.threads = job->threads;
+      candidate.board = job->board;
+      candidate.dead = job->dead;
+    } else {
+      candidate.board = rbPermuteSuits(job->board, rbcache_perms[p]);
+      candidate.dead = rbPermuteSuits(job->dead, rbcache_perms[p]);
+    }
+
+    /*
+     * Insertion sort of the pockets, unless sampling where the order
+     * of the players matters to the cards they are dealt.
+     */
+    for(i = 0; i < job->pockets_size; i++) {
+      StdDeck_CardMask pocket = job->iterations > 0 ? job->pockets[i] : rbPermuteSuits(job->pockets[i], rbcache_perms[p]);
+      int numToDeal = job->numToDeal[i + 1];
+      for(j = i; j > 0 && job->iterations == 0; j--) {
+        int cmp = memcmp(&candidate.pockets[j - 1], &pocket, sizeof(StdDeck_CardMask));
+        if(cmp < 0 || (cmp == 0 && candidate.numToDeal[j] <= numToDeal))
+          break;
+        candidate.pockets[j] = candidate.pockets[j - 1];
+        candidate.numToDeal[j + 1] = candidate.numToDeal[j];
+        candidate_order[j] = candidate_order[j - 1];
+      }
+      candidate.pockets[j] = pocket;
+      candidate.numToDeal[j + 1] = numToDeal;
+      candidate_order[j] = i;
+    }
+
+    if(p == 0 || memcmp(&candidate, key, sizeof(rbcache_key_t)) < 0) {
+      memcpy(key, &candidate, sizeof(rbcache_key_t));
+      memcpy(order, candidate_order, sizeof(candidate_order));
+    }
+  }
+}
+
+/*
+ * FNV-1a
+ */
+static uint64_t
+rbCacheHash(rbcache_key_t* key)
 {
-    cPokerEval = rb_define_class("PokerEval", rb_cObject);
-    rb_define_singleton_method(cPokerEval, "eval", t_eval, 1);
-    rb_define_singleton_method(cPokerEval, "eval_hand", t_eval_hand, 1);
+  const unsigned char* bytes = (const unsigned char*)key;
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  size_t i;
+
+  for(i = 0; i < sizeof(rbcache_key_t); i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ULL;
+  }
+
+  return hash;
+}
+
+static void
+rbCacheUnlink(rbcache_entry_t* entry)
+{
+  if(entry->newer)
+    entry->newer->older = entry->older;
+  else
+    rbcache.newest = entry->older;
+  if(entry->older)
+    entry->older->newer = entry->newer;
+  else
+    rbcache.oldest = entry->newer;
+  entry->newer = entry->older = 0;
+}
+
+static void
+rbCachePushNewest(rbcache_entry_t* entry)
+{
+  entry->older = rbcache.newest;
+  entry->newer = 0;
+  if(rbcache.newest)
+    rbcache.newest->newer = entry;
+  rbcache.newest = entry;
+  if(rbcache.oldest == 0)
+    rbcache.oldest = entry;
+}
+
+static void
+rbCacheEvictOldest(void)
+{
+  rbcache_entry_t* entry = rbcache.oldest;
+  rbcache_entry_t** link;
+
+  if(entry == 0)
+    return;
+
+  link = &rbcache.buckets[entry->hash & (rbcache.nbuckets - 1)];
+  while(*link != entry)
+    link = &(*link)->next;
+  *link = entry->next;
+
+  rbCacheUnlink(entry);
+  xfree(entry);
+  rbcache.size--;
+}
+
+static void
+rbCacheClear(void)
+{
+  while(rbcache.size > 0)
+    rbCacheEvictOldest();
+  rbcache.hits = rbcache.misses = 0;
+}
+
+static void
+rbCacheResize(int capacity)
+{
+  rbcache_entry_t* entry;
+  int nbuckets;
+
+  while(rbcache.size > capacity)
+    rbCacheEvictOldest();
+
+  rbcache.capacity = capacity;
+
+  nbuckets = 1;
+  while(nbuckets < capacity && nbuckets <= INT_MAX / 2)
+    nbuckets <<= 1;
+
+  if(capacity > 0 && nbuckets > rbcache.nbuckets) {
+    /*
+     * The bucket array grows with the capacity and never shrinks: the
+     * entries kept are rehashed into the new one.
+     */
+    if(rbcache.buckets)
+      xfree(rbcache.buckets);
+    rbcache.nbuckets = nbuckets;
+    rbcache.buckets = ALLOC_N(rbcache_entry_t*, rbcache.nbuckets);
+    memset(rbcache.buckets, '\0', sizeof(rbcache_entry_t*) * rbcache.nbuckets);
+    for(entry = rbcache.newest; entry; entry = entry->older) {
+      rbcache_entry_t** bucket = &rbcache.buckets[entry->hash & (rbcache.nbuckets - 1)];
+      entry->next = *bucket;
+      *bucket = entry;
+    }
+  }
+}
+
+static rbcache_entry_t*
+rbCacheLookup(rbcache_key_t* key, uint64_t hash)
+{
+  rbcache_entry_t* entry;
+
+  for(entry = rbcache.buckets[hash & (rbcache.nbuckets - 1)]; entry; entry = entry->next) {
+    if(entry->hash == hash && !memcmp(&entry->key, key, sizeof(rbcache_key_t)))
+      break;
+  }
+
+  return entry;
+}
+
+/*
+ * Set the job result to value, whose players are in job->cache_order.
+ */
+static void
+rbCacheValue2Result(rbeval_job_t* job, rbcache_value_t* value)
+{
+  int i;
+
+  rbenumResultClear(&job->result);
+  job->result.game = job->params->game;
+  job->result.nplayers = job->pockets_size;
+  job->result.sampleType = job->iterations > 0 ? ENUM_SAMPLE : ENUM_EXHAUSTIVE;
+  job->result.nsamples = value->nsamples;
+  for(i = 0; i < job->pockets_size; i++) {
+    int player = job->cache_order[i];
+    job->result.players[player] = value->players[i];
+  }
+  job->cached = 1;
+  job->err = 0;
+}
+
+/*
+ * Look the job up in the cache. On a hit, fill job->result with the
+ * cached counts of each player and return 1.
+ */
+static int
+rbCacheFetch(rbeval_job_t* job)
+{
+  rbcache_entry_t* entry;
+  uint64_t hash;
+
+  job->cached = 0;
+  job->cache_keyed = 0;
+  if(rbcache.capacity == 0 || (job->iterations > 0 && !job->seeded) || job->target_stderr > 0)
+    return 0;
+
+  rbCacheKey(job, &job->cache_key, job->cache_order);
+  job->cache_keyed = 1;
+  hash = rbCacheHash(&job->cache_key);
+
+  entry = rbCacheLookup(&job->cache_key, hash);
+
+  if(entry == 0) {
+    rbcache.misses++;
+    return 0;
+  }
+
+  rbcache.hits++;
+  rbCacheUnlink(entry);
+  rbCachePushNewest(entry);
+
+  rbCacheValue2Result(job, &entry->value);
+
+  return 1;
+}
+
+/*
+ * Remember the result of a job that missed the cache.
+ */
+static void
+rbCacheStore(rbeval_job_t* job)
+{
+  rbcache_entry_t* entry;
+  rbcache_entry_t** bucket;
+  uint64_t hash;
+  int i;
+
+  /*
+   * The cache may have been enabled or disabled by another thread while
+   * the job was running without the GVL.
+   */
+  if(rbcache.capacity == 0 || !job->cache_keyed || job->cached || job->err != 0 || job->partial)
+    return;
+
+  /*
+   * Another job of the same batch may already have stored it
+   */
+  hash = rbCacheHash(&job->cache_key);
+  if(rbCacheLookup(&job->cache_key, hash) != 0)
+    return;
+
+  entry = ALLOC(rbcache_entry_t);
+  memset(entry, '\0', sizeof(rbcache_entry_t));
+  memcpy(&entry->key, &job->cache_key, sizeof(rbcache_key_t));
+  entry->hash = hash;
+  entry->value.nsamples = job->result.nsamples;
+  for(i = 0; i < job->pockets_size; i++) {
+    int player = job->cache_order[i];
+    entry->value.players[i] = job->result.players[player];
+  }
+
+  bucket = &rbcache.buckets[entry->hash & (rbcache.nbuckets - 1)];
+  entry->next = *bucket;
+  *bucket = entry;
+  rbCachePushNewest(entry);
+  rbcache.size++;
+
+  while(rbcache.size > rbcache.capacity)
+    rbCacheEvictOldest();
+}
+
+/*
+ * Precomputed heads-up holdem preflop table: for every matchup of two
+ * known pockets, up to suit isomorphism, the number of boards the first
+ * pocket wins, ties and loses. The file is written by
+ * PokerEval.generate_preflop_table and mapped read only by
+ * PokerEval.load_preflop_table, so that processes loading the same file
+ * share its pages. It is in native byte order.
+ */
+#define RBPREFLOP_MAGIC "PKEVPF\0\0"
+#define RBPREFLOP_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+  uint32_t nentries;
+  uint32_t nsamples;
+} rbpreflop_header_t;
+
+/*
+ * key packs the card indexes of the two canonical pockets, 6 bits each,
+ * lowest card of the first pocket in the lowest bits. Entries are sorted
+ * by key.
+ */
+typedef struct {
+  uint32_t key;
+  uint32_t win;
+  uint32_t tie;
+  uint32_t lose;
+} rbpreflop_entry_t;
+
+typedef struct {
+  void* map;
+  size_t size;
+  rbpreflop_header_t* header;
+  rbpreflop_entry_t* entries;
+} rbpreflop_t;
+
+static rbpreflop_t rbpreflop;
+
+static uint32_t
+rbPreflopKey(rbcache_key_t* key)
+{
+  uint32_t packed = 0;
+  int shift = 0;
+  int i, card;
+
+  for(i = 0; i < 2; i++) {
+    for(card = 0; card < StdDeck_N_CARDS; card++) {
+      if(StdDeck_CardMask_CARD_IS_SET(key->pockets[i], card)) {
+        packed |= (uint32_t)card << shift;
+        shift += 6;
+      }
+    }
+  }
+
+  return packed;
+}
+
+/*
+ * Only exhaustive heads-up holdem with two known pockets of exactly 2
+ * cards, no board and no dead cards is in the table.
+ */
+static int
+rbPreflopMatches(rbeval_job_t* job)
+{
+  return job->params->game == game_holdem &&
+    job->iterations == 0 &&
+    job->pockets_size == 2 &&
+    job->numToDeal[0] == 5 && job->numToDeal[1] == 0 && job->numToDeal[2] == 0 &&
+    __builtin_popcountll(job->pockets[0].cards_n) == 2 &&
+    __builtin_popcountll(job->pockets[1].cards_n) == 2 &&
+    StdDeck_CardMask_IS_EMPTY(job->board) &&
+    StdDeck_CardMask_IS_EMPTY(job->dead);
+}
+
+/*
+ * Look the job up in the preflop table. On a hit, fill job->result and
+ * return 1.
+ */
+static int
+rbPreflopFetch(rbeval_job_t* job)
+{
+  rbpreflop_entry_t* entry = 0;
+  rbcache_value_t value;
+  uint32_t packed;
+  int low, high;
+
+  if(rbpreflop.header == 0 || !rbPreflopMatches(job))
+    return 0;
+
+  rbCacheKey(job, &job->cache_key, job->cache_order);
+  job->cache_keyed = 1;
+  packed = rbPreflopKey(&job->cache_key);
+
+  low = 0;
+  high = (int)rbpreflop.header->nentries - 1;
+  while(low <= high) {
+    int middle = low + (high - low) / 2;
+    if(rbpreflop.entries[middle].key < packed) {
+      low = middle + 1;
+    } else if(rbpreflop.entries[middle].key > packed) {
+      high = middle - 1;
+    } else {
+      entry = &rbpreflop.entries[middle];
+      break;
+    }
+  }
+
+  if(entry == 0)
+    return 0;
+
+  memset(&value, '\0', sizeof(rbcache_value_t));
+  value.nsamples = rbpreflop.header->nsamples;
+  value.players[0].nscoop = value.players[0].nwinhi = value.players[1].nlosehi = entry->win;
+  value.players[1].nscoop = value.players[1].nwinhi = value.players[0].nlosehi = entry->lose;
+  value.players[0].ntiehi = value.players[1].ntiehi = entry->tie;
+  value.players[0].ev = (double)entry->win * RBENUM_EV_UNIT + (double)entry->tie * (RBENUM_EV_UNIT / 2);
+  value.players[1].ev = (double)entry->lose * RBENUM_EV_UNIT + (double)entry->tie * (RBENUM_EV_UNIT / 2);
+  rbCacheValue2Result(job, &value);
+
+  return 1;
+}
+
+static void
+rbPreflopUnload(void)
+{
+  if(rbpreflop.map != 0)
+    munmap(rbpreflop.map, rbpreflop.size);
+  memset(&rbpreflop, '\0', sizeof(rbpreflop_t));
+}
+
+static void*
+rbeval_worker_run(void* ptr)
+{
+  rbeval_worker_t* worker = (rbeval_worker_t*)ptr;
+  rbeval_job_t* job = worker->job;
+
+  if(job->iterations > 0) {
+    worker->err = rbenumSample(job->params->game, job->pockets, job->numToDeal, job->board, job->dead, job->pockets_size + 1, worker->iterations, &worker->result, &worker->rng, &job->interrupted, job->monitor != 0 ? &worker->progress : 0);
+  } else {
+    worker->err = rbenumExhaustive(job->params->game, job->pockets, job->numToDeal, job->board, job->dead, job->pockets_size + 1, &worker->result, worker->partition, job->threads, job->canonical, &job->interrupted, job->monitor != 0 ? &worker->progress : 0);
+  }
+
+  return 0;
+}
+
+/*
+ * Enumeration on job->threads threads, the calling one included. Each
+ * thread accumulates into its own rbenum_result_t and the results are
+ * merged once all of them are done.
+ */
+static int
+rbeval_run_threads(rbeval_job_t* job)
+{
+  int i;
+  int err = 0;
+  rbeval_worker_t* workers;
+
+  workers = (rbeval_worker_t*)calloc(job->threads, sizeof(rbeval_worker_t));
+  if(workers == 0)
+    return 1;
+
+  for(i = 0; i < job->threads; i++) {
+    workers[i].job = job;
+    workers[i].partition = i;
+    workers[i].iterations = job->iterations / job->threads + (i < job->iterations % job->threads);
+    workers[i].progress.monitor = job->monitor;
+    rbenumRngSeed(&workers[i].rng, job->seed, i);
+  }
+
+  if(job->monitor != 0) {
+    pthread_mutex_lock(&job->monitor->lock);
+    job->workers = workers;
+    pthread_mutex_unlock(&job->monitor->lock);
+  }
+
+  for(i = 1; i < job->threads; i++)
+    workers[i].started = pthread_create(&workers[i].thread, 0, rbeval_worker_run, &workers[i]) == 0;
+
+  rbeval_worker_run(&workers[0]);
+
+  /*
+   * A partition whose thread could not be created is enumerated here.
+   */
+  for(i = 1; i < job->threads; i++) {
+    if(workers[i].started)
+      pthread_join(workers[i].thread, 0);
+    else
+      rbeval_worker_run(&workers[i]);
+  }
+
+  rbenumResultClear(&job->result);
+  for(i = 0; i < job->threads; i++) {
+    if(workers[i].err == RBENUM_INTERRUPTED)
+      err = RBENUM_INTERRUPTED;
+    else if(workers[i].err != 0 && err == 0)
+      err = workers[i].err;
+    rbenumResultMerge(&job->result, &workers[i].result);
+  }
+
+  if(job->monitor != 0) {
+    pthread_mutex_lock(&job->monitor->lock);
+    job->workers = 0;
+    pthread_mutex_unlock(&job->monitor->lock);
+  }
+  free(workers);
+
+  return err;
+}
+
+/*
+ * Cards that are neither in board nor in the dead cards or pockets of
+ * job, in increasing order.
+ */
+static int
+rbevalLiveCards(rbeval_job_t* job, StdDeck_CardMask board, int live[])
+{
+  StdDeck_CardMask used;
+  int nlive = 0;
+  int i;
+
+  StdDeck_CardMask_OR(used, board, job->dead);
+  for(i = 0; i < job->pockets_size; i++)
+    StdDeck_CardMask_OR(used, used, job->pockets[i]);
+  for(i = 0; i < StdDeck_N_CARDS; i++) {
+    if(!StdDeck_CardMask_CARD_IS_SET(used, i))
+      live[nlive++] = i;
+  }
+
+  return nlive;
+}
+
+/*
+ * Advance index, the increasing indices of ncards live cards, to the
+ * next combination. Returns 0 after the last one.
+ */
+static int
+rbevalNextRunout(int index[], int ncards, int nlive)
+{
+  int k;
+
+  for(k = ncards - 1; k >= 0 && index[k] == nlive - ncards + k; k--)
+    ;
+  if(k < 0)
+    return 0;
+  index[k]++;
+  for(k++; k < ncards; k++)
+    index[k] = index[k - 1] + 1;
+
+  return 1;
+}
+
+/*
+ * Number of ways of picking ncards among the ndealt cards dealt to the
+ * board: how many times enumerating the runouts of ncards cards first
+ * deals each board of a plain enumeration.
+ */
+static uint64_t
+rbevalOrders(int ndealt, int ncards)
+{
+  uint64_t orders = 1;
+  int i;
+
+  for(i = 0; i < ncards; i++)
+    orders = orders * (ndealt - i) / (i + 1);
+
+  return orders;
+}
+
+/*
+ * Number of board cards dealt by the runouts of the histogram street, or
+ * -1 when the street is not after the known board cards or is past the
+ * complete board.
+ */
+static int
+rbevalHistogramCards(rbeval_job_t* job)
+{
+  int known = __builtin_popcountll(job->board.cards_n);
+  int street = job->histogram_street < 0 ? known + job->numToDeal[0] : job->histogram_street;
+
+  if(street <= known || street > known + job->numToDeal[0])
+    return -1;
+  return street - known;
+}
+
+/*
+ * Enumerate the cards dealt after runout, add the counts to the worker
+ * result and the equity of every player to the worker histogram.
+ */
+static int
+rbevalHistogramRunout(rbeval_worker_t* worker, StdDeck_CardMask runout, int ncards)
+{
+  rbeval_job_t* job = worker->job;
+  rbeval_histogram_t* histogram = &worker->histogram;
+  StdDeck_CardMask board;
+  int numToDeal[ENUM_MAXPLAYERS + 1];
+  rbenum_result_t scratch;
+  int err;
+  int i;
+
+  StdDeck_CardMask_OR(board, job->board, runout);
+  memcpy(numToDeal, job->numToDeal, sizeof(numToDeal));
+  numToDeal[0] -= ncards;
+
+  err = rbenumExhaustive(job->params->game, job->pockets, numToDeal, board, job->dead, job->pockets_size + 1, &scratch, 0, 1, job->canonical, &job->interrupted, 0);
+  if(err != 0)
+    return err;
+  rbenumResultMerge(&worker->result, &scratch);
+  if(scratch.nsamples == 0)
+    return 0;
+
+  histogram->nrunouts++;
+  for(i = 0; i < job->pockets_size; i++) {
+    double equity = scratch.players[i].ev / RBENUM_EV_UNIT / scratch.nsamples;
+    int bucket = (int)(equity * job->histogram_buckets);
+
+    if(bucket >= job->histogram_buckets)
+      bucket = job->histogram_buckets - 1;
+    histogram->counts[i][bucket]++;
+    histogram->sumsq[i] += equity * equity;
+  }
+
+  return 0;
+}
+
+/*
+ * Every job->threads-th runout of the histogram street, or
+ * worker->iterations runouts drawn from the worker random stream.
+ */
+static void*
+rbeval_histogram_worker_run(void* ptr)
+{
+  rbeval_worker_t* worker = (rbeval_worker_t*)ptr;
+  rbeval_job_t* job = worker->job;
+  int ncards = rbevalHistogramCards(job);
+  StdDeck_CardMask runout;
+  int live[StdDeck_N_CARDS];
+  int index[StdDeck_N_CARDS];
+  int nlive = rbevalLiveCards(job, job->board, live);
+  int64_t n;
+  int k;
+
+  worker->err = 0;
+  if(ncards < 1 || nlive < ncards) {
+    worker->err = 1;
+    return 0;
+  }
+
+  if(job->iterations > 0) {
+    for(n = 0; n < worker->iterations && worker->err == 0; n++) {
+      StdDeck_CardMask_RESET(runout);
+      for(k = 0; k < ncards; k++) {
+        int pick = k + rbenumRngBelow(&worker->rng, nlive - k);
+        int card = live[pick];
+        live[pick] = live[k];
+        live[k] = card;
+        StdDeck_CardMask_SET(runout, card);
+      }
+      worker->err = rbevalHistogramRunout(worker, runout, ncards);
+    }
+    return 0;
+  }
+
+  for(k = 0; k < ncards; k++)
+    index[k] = k;
+  for(n = 0; worker->err == 0; n++) {
+    if(job->interrupted) {
+      worker->err = RBENUM_INTERRUPTED;
+      break;
+    }
+    if(n % job->threads == worker->partition) {
+      StdDeck_CardMask_RESET(runout);
+      for(k = 0; k < ncards; k++)
+        StdDeck_CardMask_SET(runout, live[index[k]]);
+      worker->err = rbevalHistogramRunout(worker, runout, ncards);
+    }
+    if(!rbevalNextRunout(index, ncards, nlive))
+      break;
+  }
+
+  return 0;
+}
+
+/*
+ * Histogram of the job on job->threads threads. The counts of the cards
+ * dealt after every runout add up to those of the whole enumeration.
+ */
+static int
+rbeval_run_histogram(rbeval_job_t* job)
+{
+  int i, p, b;
+  int err = 0;
+  rbeval_worker_t* workers;
+
+  workers = (rbeval_worker_t*)calloc(job->threads, sizeof(rbeval_worker_t));
+  if(workers == 0)
+    return 1;
+
+  for(i = 0; i < job->threads; i++) {
+    workers[i].job = job;
+    workers[i].partition = i;
+    workers[i].iterations = job->iterations / job->threads + (i < job->iterations % job->threads);
+    rbenumRngSeed(&workers[i].rng, job->seed, i);
+  }
+
+  for(i = 1; i < job->threads; i++)
+    workers[i].started = pthread_create(&workers[i].thread, 0, rbeval_histogram_worker_run, &workers[i]) == 0;
+  rbeval_histogram_worker_run(&workers[0]);
+  for(i = 1; i < job->threads; i++) {
+    if(workers[i].started)
+      pthread_join(workers[i].thread, 0);
+    else
+      rbeval_histogram_worker_run(&workers[i]);
+  }
+
+  rbenumResultClear(&job->result);
+  memset(&job->histogram, '\0', sizeof(rbeval_histogram_t));
+  for(i = 0; i < job->threads; i++) {
+    if(workers[i].err == RBENUM_INTERRUPTED)
+      err = RBENUM_INTERRUPTED;
+    else if(workers[i].err != 0 && err == 0)
+      err = workers[i].err;
+    rbenumResultMerge(&job->result, &workers[i].result);
+    job->histogram.nrunouts += workers[i].histogram.nrunouts;
+    for(p = 0; p < job->pockets_size; p++) {
+      for(b = 0; b < job->histogram_buckets; b++)
+        job->histogram.counts[p][b] += workers[i].histogram.counts[p][b];
+      job->histogram.sumsq[p] += workers[i].histogram.sumsq[p];
+    }
+  }
+
+  /*
+   * Enumerating the runouts first deals every board of the complete
+   * enumeration once per way of picking the runout cards among the
+   * cards it deals: the counts are exact multiples of the plain ones.
+   */
+  if(job->iterations == 0 && err == 0)
+    rbenumResultDivide(&job->result, rbevalOrders(job->numToDeal[0], rbevalHistogramCards(job)));
+  free(workers);
+
+  return err;
+}
+
+/*
+ * When no pocket card is dealt, the deals of a street are those of the
+ * next street and, for each card c revealed at the next street, the
+ * deals of the boards holding the cards revealed before c but not c.
+ * Every deal of the first street is then enumerated exactly once for
+ * all streets. Otherwise a card missing from the board may be dealt to
+ * a pocket instead and every street is enumerated on its own.
+ */
+static int
+rbevalStreetsShared(rbeval_job_t* job)
+{
+  int i;
+
+  for(i = 1; i <= job->pockets_size; i++) {
+    if(job->numToDeal[i] > 0)
+      return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * The worker partition of the deals of every street that are not deals
+ * of the next street, when they are shared, in worker->streets.
+ */
+static void*
+rbeval_streets_worker_run(void* ptr)
+{
+  rbeval_worker_t* worker = (rbeval_worker_t*)ptr;
+  rbeval_job_t* job = worker->job;
+  int shared = rbevalStreetsShared(job);
+  StdDeck_CardMask board;
+  rbenum_result_t scratch;
+  int level, card;
+
+  worker->err = 0;
+  StdDeck_CardMask_RESET(board);
+  for(level = 0; level < job->nstreets && worker->err == 0; level++) {
+    int numToDeal[ENUM_MAXPLAYERS + 1];
+    StdDeck_CardMask known, dead;
+
+    StdDeck_CardMask_OR(board, board, job->street_cards[level]);
+    memcpy(numToDeal, job->numToDeal, sizeof(numToDeal));
+    numToDeal[0] -= job->streets[level] - job->streets[0];
+
+    if(!shared || level == job->nstreets - 1) {
+      worker->err = rbenumExhaustive(job->params->game, job->pockets, numToDeal, board, job->dead, job->pockets_size + 1, &worker->streets[level], worker->partition, job->threads, job->canonical, &job->interrupted, 0);
+      continue;
+    }
+
+    rbenumResultClear(&worker->streets[level]);
+    known = board;
+    for(card = 0; card < StdDeck_N_CARDS && worker->err == 0; card++) {
+      if(!StdDeck_CardMask_CARD_IS_SET(job->street_cards[level + 1], card))
+        continue;
+      dead = job->dead;
+      StdDeck_CardMask_SET(dead, card);
+      worker->err = rbenumExhaustive(job->params->game, job->pockets, numToDeal, known, dead, job->pockets_size + 1, &scratch, worker->partition, job->threads, job->canonical, &job->interrupted, 0);
+      rbenumResultMerge(&worker->streets[level], &scratch);
+      StdDeck_CardMask_SET(known, card);
+      numToDeal[0]--;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Exhaustive enumeration of every street of the job on job->threads
+ * threads, each one splitting every enumeration by partition.
+ */
+static int
+rbeval_run_streets(rbeval_job_t* job)
+{
+  int i, level;
+  int err = 0;
+  rbeval_worker_t* workers;
+
+  workers = (rbeval_worker_t*)calloc(job->threads, sizeof(rbeval_worker_t));
+  if(workers == 0)
+    return 1;
+
+  for(i = 0; i < job->threads; i++) {
+    workers[i].job = job;
+    workers[i].partition = i;
+  }
+
+  for(i = 1; i < job->threads; i++)
+    workers[i].started = pthread_create(&workers[i].thread, 0, rbeval_streets_worker_run, &workers[i]) == 0;
+  rbeval_streets_worker_run(&workers[0]);
+  for(i = 1; i < job->threads; i++) {
+    if(workers[i].started)
+      pthread_join(workers[i].thread, 0);
+    else
+      rbeval_streets_worker_run(&workers[i]);
+  }
+
+  for(level = 0; level < job->nstreets; level++)
+    rbenumResultClear(&job->street_results[level]);
+  for(i = 0; i < job->threads; i++) {
+    if(workers[i].err == RBENUM_INTERRUPTED)
+      err = RBENUM_INTERRUPTED;
+    else if(workers[i].err != 0 && err == 0)
+      err = workers[i].err;
+    for(level = 0; level < job->nstreets; level++)
+      rbenumResultMerge(&job->street_results[level], &workers[i].streets[level]);
+  }
+  if(rbevalStreetsShared(job)) {
+    for(level = job->nstreets - 2; level >= 0; level--)
+      rbenumResultMerge(&job->street_results[level], &job->street_results[level + 1]);
+  }
+
+  free(workers);
+
+  return err;
+}
+
+/*
+ * worker->iterations samples in blocks, recording the mean ev of every
+ * block.
+ */
+static void*
+rbeval_adaptive_worker_run(void* ptr)
+{
+  rbeval_worker_t* worker = (rbeval_worker_t*)ptr;
+  rbeval_job_t* job = worker->job;
+  int64_t remaining = worker->iterations;
+  int i;
+
+  worker->err = 0;
+  while(remaining > 0 && worker->err == 0) {
+    int block = remaining < RBEVAL_ADAPTIVE_BLOCK ? (int)remaining : RBEVAL_ADAPTIVE_BLOCK;
+    worker->err = rbenumSample(job->params->game, job->pockets, job->numToDeal, job->board, job->dead, job->pockets_size + 1, block, &worker->result, &worker->rng, &job->interrupted, 0);
+    if(worker->err != 0) {
+      rbenumResultMerge(&worker->total, &worker->result);
+      break;
+    }
+    for(i = 0; i < job->pockets_size; i++) {
+      double mean = worker->result.players[i].ev / RBENUM_EV_UNIT / worker->result.nsamples * 1000;
+      worker->sum[i] += mean;
+      worker->sumsq[i] += mean * mean;
+    }
+    worker->nblocks++;
+    rbenumResultMerge(&worker->total, &worker->result);
+    remaining -= block;
+  }
+
+  return 0;
+}
+
+/*
+ * Sample in rounds on job->threads threads until the standard error of
+ * every player's ev is at most job->target_stderr, with at least
+ * job->min_iterations and at most job->iterations samples. Each thread
+ * keeps its random stream from one round to the next, so that a seeded
+ * job stops after the same samples every time.
+ */
+static int
+rbeval_run_adaptive(rbeval_job_t* job)
+{
+  int i, p;
+  int err = 0;
+  int64_t done = 0;
+  rbeval_worker_t* workers;
+
+  workers = (rbeval_worker_t*)calloc(job->threads, sizeof(rbeval_worker_t));
+  if(workers == 0)
+    return 1;
+
+  for(i = 0; i < job->threads; i++) {
+    workers[i].job = job;
+    rbenumRngSeed(&workers[i].rng, job->seed, i);
+  }
+
+  /*
+   * The standard error is unknown, and reported as nil, until two blocks
+   * are sampled.
+   */
+  job->achieved_stderr = -1;
+  while(done < job->iterations && err == 0) {
+    int64_t round = job->threads * RBEVAL_ADAPTIVE_BLOCK * RBEVAL_ADAPTIVE_ROUND;
+    int nblocks = 0;
+
+    if(round > job->iterations - done)
+      round = job->iterations - done;
+    for(i = 0; i < job->threads; i++)
+      workers[i].iterations = round / job->threads + (i < round % job->threads);
+
+    for(i = 1; i < job->threads; i++)
+      workers[i].started = pthread_create(&workers[i].thread, 0, rbeval_adaptive_worker_run, &workers[i]) == 0;
+    rbeval_adaptive_worker_run(&workers[0]);
+    for(i = 1; i < job->threads; i++) {
+      if(workers[i].started)
+        pthread_join(workers[i].thread, 0);
+      else
+        rbeval_adaptive_worker_run(&workers[i]);
+    }
+
+    for(i = 0; i < job->threads; i++) {
+      if(workers[i].err == RBENUM_INTERRUPTED)
+        err = RBENUM_INTERRUPTED;
+      else if(workers[i].err != 0 && err == 0)
+        err = workers[i].err;
+      nblocks += workers[i].nblocks;
+    }
+    done += round;
+
+    if(nblocks < 2)
+      continue;
+    job->achieved_stderr = 0;
+    for(p = 0; p < job->pockets_size; p++) {
+      double sum = 0, sumsq = 0, variance;
+      for(i = 0; i < job->threads; i++) {
+        sum += workers[i].sum[p];
+        sumsq += workers[i].sumsq[p];
+      }
+      variance = (sumsq - sum * sum / nblocks) / (nblocks - 1);
+      if(variance > 0 && sqrt(variance / nblocks) > job->achieved_stderr)
+        job->achieved_stderr = sqrt(variance / nblocks);
+    }
+    if(done >= job->min_iterations && job->achieved_stderr <= job->target_stderr)
+      break;
+  }
+
+  rbenumResultClear(&job->result);
+  for(i = 0; i < job->threads; i++)
+    rbenumResultMerge(&job->result, &workers[i].total);
+
+  free(workers);
+
+  return err;
+}
+
+/*
+ * Monotonic time in seconds, which wall clock changes do not move
+ */
+static double
+rbevalNow(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Number of ways the cards of an exhaustive enumeration can be dealt
+ */
+static double
+rbevalDeals(rbeval_job_t* job)
+{
+  StdDeck_CardMask used;
+  double deals = 1;
+  int live = StdDeck_N_CARDS;
+  int i, k;
+
+  StdDeck_CardMask_OR(used, job->board, job->dead);
+  for(i = 0; i < job->pockets_size; i++)
+    StdDeck_CardMask_OR(used, used, job->pockets[i]);
+  for(i = 0; i < StdDeck_N_CARDS; i++) {
+    if(StdDeck_CardMask_CARD_IS_SET(used, i))
+      live--;
+  }
+  for(i = 0; i <= job->pockets_size; i++) {
+    for(k = 0; k < job->numToDeal[i]; k++)
+      deals = deals * (live - k) / (k + 1);
+    live -= job->numToDeal[i];
+  }
+
+  return deals;
+}
+
+typedef struct {
+  rbeval_job_t* job;
+  struct timespec deadline;
+  int done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} rbeval_watchdog_t;
+
+/*
+ * Sets job->interrupted to RBEVAL_EXPIRED at the deadline, unless the
+ * job is done before.
+ */
+static void*
+rbeval_watchdog_run(void* ptr)
+{
+  rbeval_watchdog_t* watchdog = (rbeval_watchdog_t*)ptr;
+  int timedout = 0;
+
+  pthread_mutex_lock(&watchdog->lock);
+  while(!watchdog->done && !timedout)
+    timedout = pthread_cond_timedwait(&watchdog->cond, &watchdog->lock, &watchdog->deadline) == ETIMEDOUT;
+  if(!watchdog->done && watchdog->job->interrupted == 0)
+    watchdog->job->interrupted = RBEVAL_EXPIRED;
+  pthread_mutex_unlock(&watchdog->lock);
+
+  return 0;
+}
+
+/*
+ * Run job with a watchdog expiring it at deadline, in rbevalNow seconds.
+ */
+static int
+rbeval_run_watched(rbeval_job_t* job, double deadline)
+{
+  rbeval_watchdog_t watchdog;
+  pthread_condattr_t attr;
+  pthread_t thread;
+  int started;
+  int err;
+
+  memset(&watchdog, '\0', sizeof(rbeval_watchdog_t));
+  watchdog.job = job;
+  watchdog.deadline.tv_sec = (time_t)deadline;
+  watchdog.deadline.tv_nsec = (long)((deadline - (time_t)deadline) * 1e9);
+  pthread_mutex_init(&watchdog.lock, 0);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&watchdog.cond, &attr);
+  pthread_condattr_destroy(&attr);
+  started = pthread_create(&thread, 0, rbeval_watchdog_run, &watchdog) == 0;
+
+  if(job->target_stderr > 0)
+    err = rbeval_run_adaptive(job);
+  else
+    err = rbeval_run_threads(job);
+
+  if(started) {
+    pthread_mutex_lock(&watchdog.lock);
+    watchdog.done = 1;
+    pthread_cond_signal(&watchdog.cond);
+    pthread_mutex_unlock(&watchdog.lock);
+    pthread_join(thread, 0);
+  }
+  pthread_mutex_destroy(&watchdog.lock);
+  pthread_cond_destroy(&watchdog.cond);
+
+  return err;
+}
+
+/*
+ * Run job before its deadline. The runouts an exhaustive enumeration
+ * gets through before it is stopped are a biased subset of them, never
+ * a result: an exhaustive enumeration is only tried when it is expected
+ * to take at most half of the time, and is stopped then. Otherwise, or
+ * when it is stopped, the job samples until the deadline and whatever
+ * was sampled by then is the (partial) result.
+ */
+static int
+rbeval_run_deadline(rbeval_job_t* job)
+{
+  double start = rbevalNow();
+  double deadline = start + job->deadline_ms / 1000.0;
+
+  if(job->iterations == 0) {
+    double hand_ns = rbeval_hand_ns[job->params->game] > 0 ? rbeval_hand_ns[job->params->game] : RBEVAL_DEFAULT_HAND_NS;
+    double deals = rbevalDeals(job);
+
+    if(deals * job->pockets_size * hand_ns / job->threads <= job->deadline_ms * 1e6 / 2) {
+      int err = rbeval_run_watched(job, start + job->deadline_ms / 2000.0);
+
+      if(err != RBENUM_INTERRUPTED || job->interrupted != RBEVAL_EXPIRED)
+        return err;
+      job->interrupted = 0;
+    }
+    /*
+     * Sample at most as many deals as fit job->iterations: the
+     * deadline stops the sampling long before anyway.
+     */
+    job->iterations = deals < INT64_MAX ? (int64_t)deals : INT64_MAX;
+    job->partial = 1;
+  }
+
+  return rbeval_run_watched(job, deadline);
+}
+
+/*
+ * Runs without the GVL: nothing in here may call into Ruby.
+ */
+static void*
+rbeval_run(void* ptr)
+{
+  rbeval_job_t* job = (rbeval_job_t*)ptr;
+  double start = rbevalNow();
+
+  if(job->nstreets > 0)
+    job->err = rbeval_run_streets(job);
+  else if(job->histogram_buckets > 0)
+    job->err = rbeval_run_histogram(job);
+  else if(job->deadline_ms > 0)
+    job->err = rbeval_run_deadline(job);
+  else if(job->target_stderr > 0)
+    job->err = rbeval_run_adaptive(job);
+  else
+    job->err = rbeval_run_threads(job);
+
+  job->elapsed = rbevalNow() - start;
+
+  if(job->err == RBENUM_INTERRUPTED && (job->interrupted == RBEVAL_EXPIRED || job->interrupted == RBEVAL_STOPPED)) {
+    job->err = 0;
+    job->partial = 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Unblocking function: called by Ruby when the thread running rbeval_run
+ * is interrupted (Thread#raise, Thread#kill, Timeout, signals).
+ */
+static void
+rbeval_unblock(void* ptr)
+{
+  rbeval_job_t* job = (rbeval_job_t*)ptr;
+
+  job->interrupted = 1;
+}
+
+#ifndef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+static VALUE
+rbeval_run_blocking(void* ptr)
+{
+  rbeval_run(ptr);
+  return Qnil;
+}
+#endif
+
+/*
+ * Run the enumeration described by job with the GVL released. If the
+ * enumeration was interrupted, pending interrupts are handled (which
+ * raises in the common case) and the enumeration is started over.
+ */
+static void
+rbEvalJob(rbeval_job_t* job)
+{
+  for(;;) {
+    job->interrupted = 0;
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+    rb_thread_call_without_gvl(rbeval_run, job, rbeval_unblock, job);
+#else
+    rb_thread_blocking_region(rbeval_run_blocking, job, rbeval_unblock, job);
+#endif
+    if(job->err != RBENUM_INTERRUPTED)
+      break;
+    rb_thread_check_ints();
+  }
+
+  if(job->err != 0) {
+    rb_fatal("poker-eval: rbenum returned error code %d", job->err);
+  }
+}
+
+/*
+ * Update the time a hand of the game takes to evaluate from a completed
+ * job large enough to be timed.
+ */
+static void
+rbEvalMeasure(rbeval_job_t* job)
+{
+  double hands = (double)job->result.nsamples * job->pockets_size;
+  double hand_ns;
+
+  if(job->partial || job->result.nsamples < 10000 || job->params->game >= game_NUMGAMES)
+    return;
+
+  hand_ns = job->elapsed * 1e9 * job->threads / hands;
+  if(rbeval_hand_ns[job->params->game] > 0)
+    rbeval_hand_ns[job->params->game] = 0.75 * rbeval_hand_ns[job->params->game] + 0.25 * hand_ns;
+  else
+    rbeval_hand_ns[job->params->game] = hand_ns;
+}
+
+/*
+ * What t_eval returns, either as the usual hash or, when the compact
+ * argument is set, wrapped as is in a PokerEval::Result object that
+ * only creates Ruby objects for the counts it is asked for.
+ */
+typedef struct {
+  uint64_t nsamples;
+  int pockets_size;
+  int haslopot;
+  int hashipot;
+  int has_stderr;
+  double stderr_value;
+  int has_partial;
+  int partial;
+  rbenum_player_t players[ENUM_MAXPLAYERS];
+} rbeval_result_t;
+
+static VALUE cPokerEvalResult;
+
+static size_t
+rbEvalResultSize(const void* ptr)
+{
+  return sizeof(rbeval_result_t);
+}
+
+static const rb_data_type_t rbeval_result_type = {
+  "PokerEval::Result",
+  { 0, RUBY_TYPED_DEFAULT_FREE, rbEvalResultSize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static void
+rbEvalResultFill(rbeval_job_t* job, rbenum_result_t* cresult, int partial, rbeval_result_t* result)
+{
+  result->nsamples = cresult->nsamples;
+  result->pockets_size = job->pockets_size;
+  result->haslopot = job->params->haslopot;
+  result->hashipot = job->params->hashipot;
+  result->has_stderr = job->target_stderr > 0;
+  result->stderr_value = job->achieved_stderr;
+  result->has_partial = job->deadline_ms > 0 || job->monitor != 0;
+  result->partial = partial;
+  memcpy(result->players, cresult->players, job->pockets_size * sizeof(rbenum_player_t));
+}
+
+/*
+ * Pot share of player in thousandths, which the result hash truncates.
+ * A partial result stopped before its first sample has an ev of 0.
+ */
+static double
+rbEvalResultEv(rbeval_result_t* result, int player)
+{
+  if(result->nsamples == 0)
+    return 0;
+  return result->players[player].ev / RBENUM_EV_UNIT / result->nsamples * 1000;
+}
+
+static VALUE
+rbEvalResultHash(rbeval_result_t* cresult)
+{
+  int i;
+  VALUE result = rb_hash_new();
+
+  VALUE info = rb_hash_new(); 
+  rb_hash_aset(info, rbkey_samples, ULL2NUM(cresult->nsamples));
+  rb_hash_aset(info, rbkey_haslopot, INT2NUM(cresult->haslopot));
+  rb_hash_aset(info, rbkey_hashipot, INT2NUM(cresult->hashipot));
+  if(cresult->has_stderr)
+    rb_hash_aset(info, rbkey_stderr, cresult->stderr_value < 0 ? Qnil : DBL2NUM(cresult->stderr_value));
+  if(cresult->has_partial)
+    rb_hash_aset(info, rbkey_partial, INT2NUM(cresult->partial));
+
+  rb_hash_aset(result, rbkey_info, info);
+
+  VALUE list = rb_ary_new2(cresult->pockets_size);
+  for(i = 0; i < cresult->pockets_size; i++) {
+    VALUE tmp = rb_hash_new(); 
+    rb_hash_aset(tmp, rbkey_scoop, ULL2NUM(cresult->players[i].nscoop));
+    rb_hash_aset(tmp, rbkey_winhi, ULL2NUM(cresult->players[i].nwinhi));
+    rb_hash_aset(tmp, rbkey_losehi, ULL2NUM(cresult->players[i].nlosehi));
+    rb_hash_aset(tmp, rbkey_tiehi, ULL2NUM(cresult->players[i].ntiehi));
+    rb_hash_aset(tmp, rbkey_winlo, ULL2NUM(cresult->players[i].nwinlo));
+    rb_hash_aset(tmp, rbkey_loselo, ULL2NUM(cresult->players[i].nloselo));
+    rb_hash_aset(tmp, rbkey_tielo, ULL2NUM(cresult->players[i].ntielo));
+    rb_hash_aset(tmp, rbkey_ev, INT2NUM(rbEvalResultEv(cresult, i)));
+    rb_ary_push(list, tmp);
+    tmp = 0;
+  }
+  rb_hash_aset(result, rbkey_eval, list);
+
+  return result;
+}
+
+static VALUE
+rbEvalResultOf(rbeval_job_t* job, rbenum_result_t* cresult, int partial)
+{
+  rbeval_result_t* result;
+  rbeval_result_t stack;
+
+  if(!job->compact) {
+    rbEvalResultFill(job, cresult, partial, &stack);
+    return rbEvalResultHash(&stack);
+  }
+
+  result = ALLOC(rbeval_result_t);
+  rbEvalResultFill(job, cresult, partial, result);
+  return TypedData_Wrap_Struct(cPokerEvalResult, &rbeval_result_type, result);
+}
+
+static rbeval_result_t*
+rbEvalResultGet(VALUE self)
+{
+  rbeval_result_t* result;
+
+  TypedData_Get_Struct(self, rbeval_result_t, &rbeval_result_type, result);
+  return result;
+}
+
+static rbenum_player_t*
+rbEvalResultPlayer(VALUE self, VALUE rbplayer)
+{
+  rbeval_result_t* result = rbEvalResultGet(self);
+  int player = NUM2INT(rbplayer);
+
+  if(player < 0 || player >= result->pockets_size)
+    rb_raise(rb_eIndexError, "player %d is not between 0 and %d", player, result->pockets_size - 1);
+  return &result->players[player];
+}
+
+static VALUE
+t_result_samples(VALUE self)
+{
+  return ULL2NUM(rbEvalResultGet(self)->nsamples);
+}
+
+static VALUE
+t_result_size(VALUE self)
+{
+  return INT2NUM(rbEvalResultGet(self)->pockets_size);
+}
+
+static VALUE
+t_result_haslopot(VALUE self)
+{
+  return INT2NUM(rbEvalResultGet(self)->haslopot);
+}
+
+static VALUE
+t_result_hashipot(VALUE self)
+{
+  return INT2NUM(rbEvalResultGet(self)->hashipot);
+}
+
+#define RBEVAL_RESULT_COUNT(name)				\
+static VALUE							\
+t_result_##name(VALUE self, VALUE player)			\
+{								\
+  return ULL2NUM(rbEvalResultPlayer(self, player)->n##name);	\
+}
+
+RBEVAL_RESULT_COUNT(scoop)
+RBEVAL_RESULT_COUNT(winhi)
+RBEVAL_RESULT_COUNT(losehi)
+RBEVAL_RESULT_COUNT(tiehi)
+RBEVAL_RESULT_COUNT(winlo)
+RBEVAL_RESULT_COUNT(loselo)
+RBEVAL_RESULT_COUNT(tielo)
+
+/*
+ * Untruncated pot share of the player, in thousandths
+ */
+static VALUE
+t_result_ev(VALUE self, VALUE player)
+{
+  rbeval_result_t* result = rbEvalResultGet(self);
+
+  rbEvalResultPlayer(self, player);
+  return DBL2NUM(rbEvalResultEv(result, NUM2INT(player)));
+}
+
+static VALUE
+t_result_to_h(VALUE self)
+{
+  return rbEvalResultHash(rbEvalResultGet(self));
+}
+
+/*
+ * info["runouts"] and, for every player, "histogram", the number of
+ * runouts in each bucket of equity, and "ehs2", the mean of the squared
+ * equity over the runouts.
+ */
+static void
+rbEvalHistogramAdd(rbeval_job_t* job, VALUE result)
+{
+  rbeval_histogram_t* histogram = &job->histogram;
+  VALUE list = rb_hash_aref(result, rbkey_eval);
+  int i, b;
+
+  rb_hash_aset(rb_hash_aref(result, rbkey_info), rbkey_runouts, ULL2NUM(histogram->nrunouts));
+  for(i = 0; i < job->pockets_size; i++) {
+    VALUE player = rb_ary_entry(list, i);
+    VALUE counts = rb_ary_new2(job->histogram_buckets);
+
+    for(b = 0; b < job->histogram_buckets; b++)
+      rb_ary_push(counts, ULL2NUM(histogram->counts[i][b]));
+    rb_hash_aset(player, rbkey_histogram, counts);
+    rb_hash_aset(player, rbkey_ehs2, DBL2NUM(histogram->nrunouts > 0 ? histogram->sumsq[i] / histogram->nrunouts : 0.0));
+  }
+}
+
+static VALUE
+rbEvalResult(rbeval_job_t* job)
+{
+  VALUE result = rbEvalResultOf(job, &job->result, job->partial);
+
+  if(job->histogram_buckets > 0)
+    rbEvalHistogramAdd(job, result);
+  return result;
+}
+
+/*
+ * Range evaluation. A t_eval pocket given as a string instead of a list
+ * of cards is a weighted range of holdem starting hands, such as
+ * "QQ+,AKs,0.5:AQo": comma separated pairs ("QQ", "QQ+", "QQ-88"),
+ * other hands ("AK", "AKs", "AKo", "ATs+", "AKo-ATo") or exact cards
+ * ("AsKs"), each optionally prefixed with a weight and a colon. A list of
+ * cards with "__" placeholders is the range of every hand holding the
+ * known cards.
+ *
+ * Every combination of hands that does not share a card with another
+ * hand, the board or the dead cards is counted with the product of the
+ * weights of its hands. When there are at most RBRANGE_EXACT_LIMIT
+ * showdowns to evaluate, every such combination is enumerated against
+ * every runout; otherwise (or when iterations is given) the hands are
+ * drawn in proportion to their weights and the runouts at random.
+ */
+#define RBRANGE_MAXCOMBOS 1326
+#define RBRANGE_EXACT_LIMIT 20000000.0
+#define RBRANGE_ITERATIONS 200000
+#define RBRANGE_MAXREJECTS 1000000
+
+static const char rbrange_ranks[] = "23456789TJQKA";
+static const char rbrange_suits[] = "hdcs";
+
+typedef struct {
+  int ncombos;
+  StdDeck_CardMask combos[RBRANGE_MAXCOMBOS];
+  double weights[RBRANGE_MAXCOMBOS];
+  double cumulative[RBRANGE_MAXCOMBOS];
+} rbrange_t;
+
+/*
+ * rbenum_result_t counters, weighted.
+ */
+typedef struct {
+  double nsamples;
+  double nscoop[ENUM_MAXPLAYERS];
+  double nwinhi[ENUM_MAXPLAYERS];
+  double nlosehi[ENUM_MAXPLAYERS];
+  double ntiehi[ENUM_MAXPLAYERS];
+  double nwinlo[ENUM_MAXPLAYERS];
+  double nloselo[ENUM_MAXPLAYERS];
+  double ntielo[ENUM_MAXPLAYERS];
+  double ev[ENUM_MAXPLAYERS];
+} rbrange_result_t;
+
+typedef struct {
+  VALUE args;
+  enum_gameparams_t* params;
+  rbrange_t ranges[ENUM_MAXPLAYERS];
+  int pockets_size;
+  int numToDeal[ENUM_MAXPLAYERS + 1];
+  StdDeck_CardMask board;
+  StdDeck_CardMask dead;
+  int64_t iterations;
+  uint64_t seed;
+  int threads;
+  int canonical;
+  int exact;
+  volatile int interrupted;
+  int err;
+  rbrange_result_t result;
+} rbrange_job_t;
+
+typedef struct {
+  rbrange_job_t* job;
+  int partition;
+  int64_t iterations;
+  rbenum_rng_t rng;
+  int started;
+  pthread_t thread;
+  int err;
+  long long ordinal;
+  StdDeck_CardMask pockets[ENUM_MAXPLAYERS];
+  rbenum_result_t scratch;
+  rbrange_result_t result;
+} rbrange_worker_t;
+
+static int
+rbRangeRank(char c)
+{
+  const char* found = c ? strchr(rbrange_ranks, toupper((unsigned char)c)) : 0;
+
+  return found ? (int)(found - rbrange_ranks) : -1;
+}
+
+static int
+rbRangeSuit(char c)
+{
+  const char* found = c ? strchr(rbrange_suits, c) : 0;
+
+  return found ? (int)(found - rbrange_suits) : -1;
+}
+
+/*
+ * Set the weight of every hand of ranks high and low: suited is 1 for
+ * suited hands only, 2 for offsuit hands only and 0 for both.
+ */
+static void
+rbRangeAddHands(double weights[StdDeck_N_CARDS][StdDeck_N_CARDS], int high, int low, int suited, double weight)
+{
+  int s1, s2;
+
+  for(s1 = 0; s1 < StdDeck_Suit_COUNT; s1++) {
+    for(s2 = 0; s2 < StdDeck_Suit_COUNT; s2++) {
+      int c1 = StdDeck_MAKE_CARD(high, s1);
+      int c2 = StdDeck_MAKE_CARD(low, s2);
+      if(c1 == c2 || (high == low && s2 < s1))
+        continue;
+      if((suited == 1 && s1 != s2) || (suited == 2 && s1 == s2))
+        continue;
+      if(c1 < c2)
+        weights[c1][c2] = weight;
+      else
+        weights[c2][c1] = weight;
+    }
+  }
+}
+
+/*
+ * Parse one comma separated item of a range, without its weight.
+ * Returns 0 if it is not valid.
+ */
+static int
+rbRangeParseItem(double weights[StdDeck_N_CARDS][StdDeck_N_CARDS], const char* item, double weight)
+{
+  size_t length = strlen(item);
+  int high, low, suited = 0;
+  int last, i;
+  const char* rest;
+
+  if(length == 4 && rbRangeSuit(item[1]) >= 0 && rbRangeSuit(item[3]) >= 0) {
+    int c1, c2;
+    if(rbRangeRank(item[0]) < 0 || rbRangeRank(item[2]) < 0)
+      return 0;
+    c1 = StdDeck_MAKE_CARD(rbRangeRank(item[0]), rbRangeSuit(item[1]));
+    c2 = StdDeck_MAKE_CARD(rbRangeRank(item[2]), rbRangeSuit(item[3]));
+    if(c1 == c2)
+      return 0;
+    if(c1 < c2)
+      weights[c1][c2] = weight;
+    else
+      weights[c2][c1] = weight;
+    return 1;
+  }
+
+  if(length < 2 || rbRangeRank(item[0]) < 0 || rbRangeRank(item[1]) < 0)
+    return 0;
+  high = rbRangeRank(item[0]);
+  low = rbRangeRank(item[1]);
+  if(low > high) {
+    int swap = low;
+    low = high;
+    high = swap;
+  }
+  rest = item + 2;
+  if(*rest == 's' || *rest == 'o') {
+    if(high == low)
+      return 0;
+    suited = *rest == 's' ? 1 : 2;
+    rest++;
+  }
+
+  if(*rest == '\0') {
+    last = low;
+  } else if(!strcmp(rest, "+")) {
+    last = high == low ? StdDeck_Rank_ACE : high - 1;
+  } else if(*rest == '-') {
+    int high2, low2;
+    if(rbRangeRank(rest[1]) < 0 || rbRangeRank(rest[2]) < 0)
+      return 0;
+    high2 = rbRangeRank(rest[1]);
+    low2 = rbRangeRank(rest[2]);
+    if(low2 > high2) {
+      int swap = low2;
+      low2 = high2;
+      high2 = swap;
+    }
+    if(strcmp(rest + 3, suited == 1 ? "s" : suited == 2 ? "o" : ""))
+      return 0;
+    if(high == low ? high2 != low2 : high2 != high || low2 == high2)
+      return 0;
+    last = low2;
+  } else {
+    return 0;
+  }
+
+  for(i = low < last ? low : last; i <= (low < last ? last : low); i++) {
+    if(high == low)
+      rbRangeAddHands(weights, i, i, 0, weight);
+    else
+      rbRangeAddHands(weights, high, i, suited, weight);
+  }
+
+  return 1;
+}
+
+/*
+ * Parse the range string into weights, indexed by the lowest then the
+ * highest card of a hand. Returns 0 if it is not valid.
+ */
+static int
+rbRangeParse(double weights[StdDeck_N_CARDS][StdDeck_N_CARDS], const char* string)
+{
+  char item[64];
+  const char* start = string;
+
+  while(*start != '\0') {
+    const char* end = strchr(start, ',');
+    size_t length = end ? (size_t)(end - start) : strlen(start);
+    char* body = item;
+    double weight = 1.0;
+    char* colon;
+
+    while(length > 0 && isspace((unsigned char)*start)) {
+      start++;
+      length--;
+    }
+    while(length > 0 && isspace((unsigned char)start[length - 1]))
+      length--;
+    if(length == 0 || length >= sizeof(item))
+      return 0;
+    memcpy(item, start, length);
+    item[length] = '\0';
+
+    colon = strchr(item, ':');
+    if(colon != 0) {
+      char* weight_end;
+      *colon = '\0';
+      weight = strtod(item, &weight_end);
+      if(weight_end == item || *weight_end != '\0' || !(weight >= 0))
+        return 0;
+      body = colon + 1;
+    }
+
+    if(!rbRangeParseItem(weights, body, weight))
+      return 0;
+
+    if(end == 0)
+      break;
+    start = end + 1;
+  }
+
+  return 1;
+}
+
+/*
+ * Any t_eval pocket given as a string makes it a range evaluation.
+ */
+static int
+rbRangeArgs(VALUE args)
+{
+  VALUE rbpockets = rb_hash_aref(args, rbkey_pockets);
+  int i;
+
+  if(TYPE(rbpockets) != T_ARRAY)
+    return 0;
+  for(i = 0; i < RARRAY_LENINT(rbpockets); i++) {
+    if(TYPE(rb_ary_entry(rbpockets, i)) == T_STRING)
+      return 1;
+  }
+
+  return 0;
+}
+
+static void
+rbRangeArgs2Job(rbrange_job_t* job)
+{
+  VALUE args = job->args;
+  VALUE rbpockets = rb_hash_aref(args, rbkey_pockets);
+  VALUE rbboard = rb_hash_aref(args, rbkey_board);
+  VALUE rbdead = rb_hash_aref(args, rbkey_dead);
+  VALUE rbiterations = rb_hash_aref(args, rbkey_iterations);
+  VALUE rbthreads = rb_hash_aref(args, rbkey_threads);
+  VALUE rbseed = rb_hash_aref(args, rbkey_seed);
+  StdDeck_CardMask known[ENUM_MAXPLAYERS];
+  double (*weights)[StdDeck_N_CARDS][StdDeck_N_CARDS];
+  int i, j, c1, c2, count;
+
+  job->params = rbGameParams(RSTRING_PTR(rb_hash_aref(args, rbkey_game)));
+  if(job->params->game != game_holdem && job->params->game != game_holdem8)
+    rb_raise(rb_eArgError, "ranges are only supported in holdem and holdem8");
+
+  job->iterations = NIL_P(rbiterations) ? 0 : NUM2LL(rbiterations);
+  job->threads = NIL_P(rbthreads) ? 1 : NUM2INT(rbthreads);
+  if(job->threads < 1 || job->threads > RBEVAL_MAXTHREADS)
+    rb_raise(rb_eArgError, "threads must be between 1 and %d", RBEVAL_MAXTHREADS);
+  job->canonical = RTEST(rb_hash_aref(args, rbkey_canonical));
+  if(!NIL_P(rbseed))
+    job->seed = NUM2ULL(rbseed);
+  else
+    job->seed = ((uint64_t)rb_genrand_int32() << 32) | rb_genrand_int32();
+
+  job->pockets_size = RARRAY_LENINT(rbpockets);
+  if(job->pockets_size > ENUM_MAXPLAYERS)
+    rb_raise(rb_eArgError, "at most %d pockets are allowed", ENUM_MAXPLAYERS);
+
+  count = rbList2CardMask(rbboard, &job->board);
+  job->numToDeal[0] = rbCardListSize(rbboard) - count;
+  if(!NIL_P(rbdead) && rbCardListSize(rbdead) > 0) {
+    if(rbList2CardMask(rbdead, &job->dead) < 0)
+      rb_raise(rb_eArgError, "dead cards error");
+  }
+
+  weights = xcalloc(job->pockets_size ? job->pockets_size : 1, sizeof(*weights));
+  for(i = 0; i < job->pockets_size; i++) {
+    VALUE rbpocket = rb_ary_entry(rbpockets, i);
+
+    StdDeck_CardMask_RESET(known[i]);
+    if(TYPE(rbpocket) == T_STRING) {
+      if(!rbRangeParse(weights[i], StringValueCStr(rbpocket))) {
+        xfree(weights);
+        rb_raise(rb_eArgError, "%s is not a valid range", StringValueCStr(rbpocket));
+      }
+    } else {
+      if(rbList2CardMask(rbpocket, &known[i]) < 0 || rbCardListSize(rbpocket) != 2) {
+        xfree(weights);
+        rb_raise(rb_eArgError, "pockets must hold 2 cards");
+      }
+      for(c1 = 0; c1 < StdDeck_N_CARDS; c1++)
+        for(c2 = c1 + 1; c2 < StdDeck_N_CARDS; c2++) {
+          StdDeck_CardMask hand;
+          StdDeck_CardMask_RESET(hand);
+          StdDeck_CardMask_SET(hand, c1);
+          StdDeck_CardMask_SET(hand, c2);
+          StdDeck_CardMask_AND(hand, hand, known[i]);
+          if(StdDeck_CardMask_EQUAL(hand, known[i]))
+            weights[i][c1][c2] = 1.0;
+        }
+    }
+  }
+
+  /*
+   * Hands holding a card of the board, of the dead cards or known to be
+   * in another pocket can never be dealt.
+   */
+  for(i = 0; i < job->pockets_size; i++) {
+    rbrange_t* range = &job->ranges[i];
+    StdDeck_CardMask excluded;
+    double total = 0;
+
+    StdDeck_CardMask_OR(excluded, job->board, job->dead);
+    for(j = 0; j < job->pockets_size; j++) {
+      if(j != i)
+        StdDeck_CardMask_OR(excluded, excluded, known[j]);
+    }
+    for(c1 = 0; c1 < StdDeck_N_CARDS; c1++)
+      for(c2 = c1 + 1; c2 < StdDeck_N_CARDS; c2++) {
+        StdDeck_CardMask hand;
+        if(!(weights[i][c1][c2] > 0))
+          continue;
+        StdDeck_CardMask_RESET(hand);
+        StdDeck_CardMask_SET(hand, c1);
+        StdDeck_CardMask_SET(hand, c2);
+        if(StdDeck_CardMask_ANY_SET(hand, excluded))
+          continue;
+        range->combos[range->ncombos] = hand;
+        range->weights[range->ncombos] = weights[i][c1][c2];
+        total += weights[i][c1][c2];
+        range->cumulative[range->ncombos] = total;
+        range->ncombos++;
+      }
+    if(range->ncombos == 0) {
+      xfree(weights);
+      rb_raise(rb_eArgError, "the range of pocket %d has no hand that can be dealt", i);
+    }
+  }
+  xfree(weights);
+}
+
+static void
+rbRangeResultMerge(rbrange_result_t* to, rbrange_result_t* from)
+{
+  int i;
+
+  for(i = 0; i < ENUM_MAXPLAYERS; i++) {
+    to->nscoop[i] += from->nscoop[i];
+    to->nwinhi[i] += from->nwinhi[i];
+    to->nlosehi[i] += from->nlosehi[i];
+    to->ntiehi[i] += from->ntiehi[i];
+    to->nwinlo[i] += from->nwinlo[i];
+    to->nloselo[i] += from->nloselo[i];
+    to->ntielo[i] += from->ntielo[i];
+    to->ev[i] += from->ev[i];
+  }
+  to->nsamples += from->nsamples;
+}
+
+static void
+rbRangeAccumulate(rbrange_result_t* to, rbenum_result_t* from, int nplayers, double weight)
+{
+  int i;
+
+  for(i = 0; i < nplayers; i++) {
+    to->nscoop[i] += weight * from->players[i].nscoop;
+    to->nwinhi[i] += weight * from->players[i].nwinhi;
+    to->nlosehi[i] += weight * from->players[i].nlosehi;
+    to->ntiehi[i] += weight * from->players[i].ntiehi;
+    to->nwinlo[i] += weight * from->players[i].nwinlo;
+    to->nloselo[i] += weight * from->players[i].nloselo;
+    to->ntielo[i] += weight * from->players[i].ntielo;
+    to->ev[i] += weight * from->players[i].ev;
+  }
+  to->nsamples += weight * from->nsamples;
+}
+
+/*
+ * Number of combinations of hands that can be dealt together, or -1 as
+ * soon as there are more than limit.
+ */
+static double
+rbRangeCount(rbrange_job_t* job, int player, StdDeck_CardMask used, double count, double limit)
+{
+  rbrange_t* range = &job->ranges[player];
+  int i;
+
+  for(i = 0; i < range->ncombos && count >= 0; i++) {
+    StdDeck_CardMask next;
+    if(StdDeck_CardMask_ANY_SET(used, range->combos[i]))
+      continue;
+    if(player + 1 == job->pockets_size) {
+      count += 1;
+      if(count > limit || job->interrupted)
+        return -1;
+    } else {
+      StdDeck_CardMask_OR(next, used, range->combos[i]);
+      count = rbRangeCount(job, player + 1, next, count, limit);
+    }
+  }
+
+  return count;
+}
+
+/*
+ * Enumerate every runout of every worker->partition-th combination of
+ * hands, walked in the same order by every worker.
+ */
+static int
+rbRangeWalk(rbrange_worker_t* worker, int player, StdDeck_CardMask used, double weight)
+{
+  rbrange_job_t* job = worker->job;
+  rbrange_t* range = &job->ranges[player];
+  int i, err;
+
+  for(i = 0; i < range->ncombos; i++) {
+    StdDeck_CardMask next;
+    if(StdDeck_CardMask_ANY_SET(used, range->combos[i]))
+      continue;
+    worker->pockets[player] = range->combos[i];
+    if(player + 1 < job->pockets_size) {
+      StdDeck_CardMask_OR(next, used, range->combos[i]);
+      err = rbRangeWalk(worker, player + 1, next, weight * range->weights[i]);
+    } else if(worker->ordinal++ % job->threads == worker->partition) {
+      err = rbenumExhaustive(job->params->game, worker->pockets, job->numToDeal, job->board, job->dead, job->pockets_size + 1, &worker->scratch, 0, 1, job->canonical, &job->interrupted, 0);
+      if(err == 0)
+        rbRangeAccumulate(&worker->result, &worker->scratch, job->pockets_size, weight * range->weights[i]);
+    } else {
+      err = 0;
+    }
+    if(err != 0)
+      return err;
+  }
+
+  return 0;
+}
+
+static inline double
+rbenumRngUniform(rbenum_rng_t* rng)
+{
+  return (rbenumRngNext(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * worker->iterations showdowns, the hands of each player drawn in
+ * proportion to their weights (combinations sharing a card are drawn
+ * again) and the runout at random.
+ */
+static int
+rbRangeSample(rbrange_worker_t* worker)
+{
+  rbrange_job_t* job = worker->job;
+  StdDeck_CardMask* pockets = worker->pockets;
+  StdDeck_CardMask cardsDealt[ENUM_MAXPLAYERS + 1];
+  StdDeck_CardMask board = job->board;
+  StdDeck_CardMask dead;
+  rbenum_result_t* result = &worker->scratch;
+  volatile int* interrupted = &job->interrupted;
+  rbenum_progress_t* progress = 0;
+  int progress_next = 0;
+  int sizeToDeal = job->pockets_size + 1;
+  int weight = 1;
+  int rejects = 0;
+  int hand7;
+  int64_t n;
+  int player;
+
+  rbenumResultClear(result);
+  memset(cardsDealt, 0, sizeof(cardsDealt));
+  /*
+   * Every hand of a range has as many cards as its first one
+   */
+  for(player = 0; player < job->pockets_size; player++)
+    pockets[player] = job->ranges[player].combos[0];
+  hand7 = rbHandTableFits(pockets, job->numToDeal, board, sizeToDeal);
+  for(n = 0; n < worker->iterations; ) {
+    StdDeck_CardMask_OR(dead, job->board, job->dead);
+    for(player = 0; player < job->pockets_size; player++) {
+      rbrange_t* range = &job->ranges[player];
+      double r = rbenumRngUniform(&worker->rng) * range->cumulative[range->ncombos - 1];
+      int low = 0, high = range->ncombos - 1;
+      while(low < high) {
+        int middle = low + (high - low) / 2;
+        if(range->cumulative[middle] > r)
+          high = middle;
+        else
+          low = middle + 1;
+      }
+      if(StdDeck_CardMask_ANY_SET(dead, range->combos[low]))
+        break;
+      pockets[player] = range->combos[low];
+      StdDeck_CardMask_OR(dead, dead, range->combos[low]);
+    }
+    if(player < job->pockets_size) {
+      if(++rejects > RBRANGE_MAXREJECTS || *interrupted)
+        return *interrupted ? RBENUM_INTERRUPTED : 1;
+      continue;
+    }
+    rejects = 0;
+
+    if(job->params->game == game_holdem) {
+      RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				       sizeToDeal, job->numToDeal,
+				       dead, 1, &worker->rng, INNER_LOOP_ANY_HIGH);
+    } else {
+      RBENUM_MONTECARLO_PERMUTATIONS_D(cardsDealt,
+				       sizeToDeal, job->numToDeal,
+				       dead, 1, &worker->rng, INNER_LOOP_HOLDEM8);
+    }
+    n++;
+  }
+
+  rbRangeAccumulate(&worker->result, result, job->pockets_size, 1.0);
+
+  return 0;
+}
+
+static void*
+rbrange_worker_run(void* ptr)
+{
+  rbrange_worker_t* worker = (rbrange_worker_t*)ptr;
+  StdDeck_CardMask used;
+
+  if(worker->job->exact) {
+    StdDeck_CardMask_OR(used, worker->job->board, worker->job->dead);
+    worker->err = rbRangeWalk(worker, 0, used, 1.0);
+  } else {
+    worker->err = rbRangeSample(worker);
+  }
+
+  return 0;
+}
+
+/*
+ * Runs without the GVL, like rbeval_run.
+ */
+static void*
+rbrange_run(void* ptr)
+{
+  rbrange_job_t* job = (rbrange_job_t*)ptr;
+  rbrange_worker_t* workers;
+  int i;
+
+  job->err = 0;
+  job->exact = 0;
+  memset(&job->result, '\0', sizeof(rbrange_result_t));
+
+  if(job->iterations <= 0) {
+    StdDeck_CardMask used;
+    double runouts = 1;
+    double count;
+    int live = StdDeck_N_CARDS - 2 * job->pockets_size;
+
+    StdDeck_CardMask_OR(used, job->board, job->dead);
+    for(i = 0; i < StdDeck_N_CARDS; i++) {
+      if(StdDeck_CardMask_CARD_IS_SET(used, i))
+        live--;
+    }
+    for(i = 0; i < job->numToDeal[0]; i++)
+      runouts = runouts * (live - i) / (i + 1);
+
+    count = job->pockets_size == 0 ? 0 : rbRangeCount(job, 0, used, 0, RBRANGE_EXACT_LIMIT / runouts);
+    if(job->interrupted) {
+      job->err = RBENUM_INTERRUPTED;
+      return 0;
+    }
+    if(count == 0) {
+      job->err = 1;
+      return 0;
+    }
+    job->exact = count > 0;
+    if(!job->exact)
+      job->iterations = RBRANGE_ITERATIONS;
+  }
+
+  workers = (rbrange_worker_t*)calloc(job->threads, sizeof(rbrange_worker_t));
+  if(workers == 0) {
+    job->err = 1;
+    return 0;
+  }
+
+  for(i = 0; i < job->threads; i++) {
+    workers[i].job = job;
+    workers[i].partition = i;
+    workers[i].iterations = job->iterations / job->threads + (i < job->iterations % job->threads);
+    rbenumRngSeed(&workers[i].rng, job->seed, i);
+  }
+
+  for(i = 1; i < job->threads; i++)
+    workers[i].started = pthread_create(&workers[i].thread, 0, rbrange_worker_run, &workers[i]) == 0;
+
+  rbrange_worker_run(&workers[0]);
+
+  for(i = 1; i < job->threads; i++) {
+    if(workers[i].started)
+      pthread_join(workers[i].thread, 0);
+    else
+      rbrange_worker_run(&workers[i]);
+  }
+
+  for(i = 0; i < job->threads; i++) {
+    if(workers[i].err == RBENUM_INTERRUPTED)
+      job->err = RBENUM_INTERRUPTED;
+    else if(workers[i].err != 0 && job->err == 0)
+      job->err = workers[i].err;
+    rbRangeResultMerge(&job->result, &workers[i].result);
+  }
+
+  free(workers);
+
+  return 0;
+}
+
+static void
+rbrange_unblock(void* ptr)
+{
+  rbrange_job_t* job = (rbrange_job_t*)ptr;
+
+  job->interrupted = 1;
+}
+
+#ifndef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+static VALUE
+rbrange_run_blocking(void* ptr)
+{
+  rbrange_run(ptr);
+  return Qnil;
+}
+#endif
+
+static VALUE
+rbEvalRangesResult(rbrange_job_t* job)
+{
+  int i;
+  rbrange_result_t* cresult = &job->result;
+  VALUE result = rb_hash_new();
+
+  VALUE info = rb_hash_new();
+  rb_hash_aset(info, rbkey_samples, DBL2NUM(cresult->nsamples));
+  rb_hash_aset(info, rbkey_haslopot, INT2NUM(job->params->haslopot));
+  rb_hash_aset(info, rbkey_hashipot, INT2NUM(job->params->hashipot));
+  rb_hash_aset(info, rbkey_exact, INT2NUM(job->exact));
+
+  rb_hash_aset(result, rbkey_info, info);
+
+  VALUE list = rb_ary_new();
+  for(i = 0; i < job->pockets_size; i++) {
+    VALUE tmp = rb_hash_new();
+    rb_hash_aset(tmp, rbkey_scoop, DBL2NUM(cresult->nscoop[i]));
+    rb_hash_aset(tmp, rbkey_winhi, DBL2NUM(cresult->nwinhi[i]));
+    rb_hash_aset(tmp, rbkey_losehi, DBL2NUM(cresult->nlosehi[i]));
+    rb_hash_aset(tmp, rbkey_tiehi, DBL2NUM(cresult->ntiehi[i]));
+    rb_hash_aset(tmp, rbkey_winlo, DBL2NUM(cresult->nwinlo[i]));
+    rb_hash_aset(tmp, rbkey_loselo, DBL2NUM(cresult->nloselo[i]));
+    rb_hash_aset(tmp, rbkey_tielo, DBL2NUM(cresult->ntielo[i]));
+    rb_hash_aset(tmp, rbkey_ev, INT2NUM(cresult->nsamples > 0 ? (cresult->ev[i] / RBENUM_EV_UNIT / cresult->nsamples) * 1000 : 0));
+    rb_ary_push(list, tmp);
+  }
+  rb_hash_aset(result, rbkey_eval, list);
+
+  return result;
+}
+
+/*
+ * Same as rbEvalJob, for a range evaluation.
+ */
+static VALUE
+rbEvalRanges(VALUE ptr)
+{
+  rbrange_job_t* job = (rbrange_job_t*)ptr;
+
+  rbRangeArgs2Job(job);
+
+  for(;;) {
+    job->interrupted = 0;
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+    rb_thread_call_without_gvl(rbrange_run, job, rbrange_unblock, job);
+#else
+    rb_thread_blocking_region(rbrange_run_blocking, job, rbrange_unblock, job);
+#endif
+    if(job->err != RBENUM_INTERRUPTED)
+      break;
+    rb_thread_check_ints();
+  }
+
+  if(job->err != 0) {
+    rb_raise(rb_eArgError, "the ranges can not be dealt together (error code %d)", job->err);
+  }
+
+  return rbEvalRangesResult(job);
+}
+
+static VALUE
+rbEvalRangesFree(VALUE ptr)
+{
+  xfree((rbrange_job_t*)ptr);
+
+  return Qnil;
+}
+
+/*
+ * t_eval with a block: the enumeration runs on a thread of its own
+ * while the calling thread, without the GVL, waits for the workers to
+ * publish job->progress_every more samples, then yields the counts so
+ * far. The block returning :stop ends the enumeration, whose result is
+ * then partial.
+ */
+typedef struct {
+  rbeval_job_t* job;
+  rbenum_monitor_t monitor;
+  pthread_t runner;
+  int started;
+  unsigned int seen;
+  rbenum_result_t snapshot;
+} rbeval_progress_t;
+
+static void*
+rbeval_progress_runner(void* ptr)
+{
+  rbeval_progress_t* progress = (rbeval_progress_t*)ptr;
+
+  rbeval_run(progress->job);
+
+  pthread_mutex_lock(&progress->monitor.lock);
+  progress->monitor.finished = 1;
+  pthread_cond_broadcast(&progress->monitor.cond);
+  pthread_mutex_unlock(&progress->monitor.lock);
+
+  return 0;
+}
+
+/*
+ * Runs without the GVL: wait for the enumeration to publish or finish.
+ */
+static void*
+rbeval_progress_wait(void* ptr)
+{
+  rbeval_progress_t* progress = (rbeval_progress_t*)ptr;
+
+  pthread_mutex_lock(&progress->monitor.lock);
+  while(!progress->monitor.finished &&
+        progress->monitor.version == progress->seen &&
+        progress->job->interrupted != 1)
+    pthread_cond_wait(&progress->monitor.cond, &progress->monitor.lock);
+  progress->seen = progress->monitor.version;
+  pthread_mutex_unlock(&progress->monitor.lock);
+
+  return 0;
+}
+
+static void
+rbeval_progress_unblock(void* ptr)
+{
+  rbeval_progress_t* progress = (rbeval_progress_t*)ptr;
+
+  pthread_mutex_lock(&progress->monitor.lock);
+  progress->job->interrupted = 1;
+  pthread_cond_broadcast(&progress->monitor.cond);
+  pthread_mutex_unlock(&progress->monitor.lock);
+}
+
+#ifndef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+static VALUE
+rbeval_progress_wait_blocking(void* ptr)
+{
+  rbeval_progress_wait(ptr);
+  return Qnil;
+}
+#endif
+
+/*
+ * Sum of the counts published by the workers, 0 if there is none yet.
+ */
+static int
+rbEvalSnapshot(rbeval_progress_t* progress)
+{
+  rbeval_job_t* job = progress->job;
+  int i;
+  int any = 0;
+
+  rbenumResultClear(&progress->snapshot);
+  pthread_mutex_lock(&progress->monitor.lock);
+  if(job->workers != 0) {
+    for(i = 0; i < job->threads; i++)
+      rbenumResultMerge(&progress->snapshot, &job->workers[i].progress.published);
+    any = progress->snapshot.nsamples > 0;
+  }
+  pthread_mutex_unlock(&progress->monitor.lock);
+
+  return any;
+}
+
+static void
+rbEvalProgressJoin(rbeval_progress_t* progress)
+{
+  if(progress->started) {
+    pthread_join(progress->runner, 0);
+    progress->started = 0;
+  }
+}
+
+static VALUE
+rbEvalProgress(VALUE ptr)
+{
+  rbeval_progress_t* progress = (rbeval_progress_t*)ptr;
+  rbeval_job_t* job = progress->job;
+  VALUE stop = ID2SYM(rb_intern("stop"));
+
+  for(;;) {
+    unsigned int next = job->progress_every;
+
+    job->interrupted = 0;
+    job->err = 0;
+    progress->monitor.finished = 0;
+    progress->monitor.version = progress->seen = 0;
+    progress->started = pthread_create(&progress->runner, 0, rbeval_progress_runner, progress) == 0;
+    if(!progress->started) {
+      rbEvalJob(job);
+      break;
+    }
+
+    for(;;) {
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+      rb_thread_call_without_gvl(rbeval_progress_wait, progress, rbeval_progress_unblock, progress);
+#else
+      rb_thread_blocking_region(rbeval_progress_wait_blocking, progress, rbeval_progress_unblock, progress);
+#endif
+      if(progress->monitor.finished || job->interrupted == 1)
+        break;
+      if(job->interrupted != RBEVAL_STOPPED && rbEvalSnapshot(progress) && progress->snapshot.nsamples >= next) {
+        next = (progress->snapshot.nsamples / job->progress_every + 1) * job->progress_every;
+        if(rb_yield(rbEvalResultOf(job, &progress->snapshot, 1)) == stop)
+          job->interrupted = RBEVAL_STOPPED;
+      }
+    }
+
+    rbEvalProgressJoin(progress);
+    if(job->err != RBENUM_INTERRUPTED)
+      break;
+    rb_thread_check_ints();
+  }
+
+  if(job->err != 0) {
+    rb_fatal("poker-eval: rbenum returned error code %d", job->err);
+  }
+
+  return rbEvalResult(job);
+}
+
+/*
+ * Also reached when the block raises: stop the enumeration and wait for
+ * its threads before their memory goes away.
+ */
+static VALUE
+rbEvalProgressFree(VALUE ptr)
+{
+  rbeval_progress_t* progress = (rbeval_progress_t*)ptr;
+
+  if(progress->started) {
+    progress->job->interrupted = 1;
+    rbEvalProgressJoin(progress);
+  }
+  pthread_mutex_destroy(&progress->monitor.lock);
+  pthread_cond_destroy(&progress->monitor.cond);
+  progress->job->monitor = 0;
+  xfree(progress);
+
+  return Qnil;
+}
+
+/*
+ * Run a job parsed by rbEvalArgs2Job, or answer it from the preflop
+ * table or the cache, and return what t_eval returns.
+ */
+static VALUE
+rbEvalRun(rbeval_job_t* job)
+{
+  /*
+   * Only plain enumerations and samplings report progress to a block
+   */
+  if(rb_block_given_p() && (job->histogram_buckets > 0 || job->target_stderr > 0))
+    rb_raise(rb_eArgError, "a progress block is not supported with histogram or stderr");
+
+  /*
+   * Histograms are not cached
+   */
+  if(job->histogram_buckets > 0) {
+    if(rbevalHistogramCards(job) < 0)
+      rb_raise(rb_eArgError, "histogram_street must be after the known board cards and at most the complete board");
+    rbEvalJob(job);
+    return rbEvalResult(job);
+  }
+
+  if(rb_block_given_p() && !rbPreflopFetch(job) && !rbCacheFetch(job)) {
+    rbeval_progress_t* progress = ALLOC(rbeval_progress_t);
+    VALUE result;
+
+    MEMZERO(progress, rbeval_progress_t, 1);
+    progress->job = job;
+    progress->monitor.every = job->progress_every / job->threads > 0 ? job->progress_every / job->threads : 1;
+    pthread_mutex_init(&progress->monitor.lock, 0);
+    pthread_cond_init(&progress->monitor.cond, 0);
+    job->monitor = &progress->monitor;
+    result = rb_ensure(rbEvalProgress, (VALUE)progress, rbEvalProgressFree, (VALUE)progress);
+    rbCacheStore(job);
+    return result;
+  }
+
+  if(!job->cached && !rbPreflopFetch(job) && !rbCacheFetch(job)) {
+    rbEvalJob(job);
+    rbCacheStore(job);
+    rbEvalMeasure(job);
+  }
+
+  return rbEvalResult(job);
+}
+
+/*
+ * Raise for the first of the nkeys options given in args, which what
+ * does not support, rather than silently run without it.
+ */
+static void
+rbEvalCheckUnsupported(VALUE args, const VALUE keys[], size_t nkeys, const char* what)
+{
+  size_t i;
+
+  for(i = 0; i < nkeys; i++) {
+    if(!NIL_P(rb_hash_aref(args, keys[i])))
+      rb_raise(rb_eArgError, "%s is not supported %s", RSTRING_PTR(keys[i]), what);
+  }
+}
+
+/*
+ * Raise for the t_eval options that range evaluation does not support.
+ * Range results are not cached.
+ */
+static void
+rbRangeCheckOptions(VALUE args)
+{
+  VALUE unsupported[] = { rbkey_deadline_ms, rbkey_stderr, rbkey_min_iterations, rbkey_max_iterations, rbkey_histogram, rbkey_histogram_street };
+
+  rbEvalCheckUnsupported(args, unsupported, sizeof(unsupported) / sizeof(unsupported[0]), "with ranges");
+  /*
+   * Range counts are weighted, which a PokerEval::Result can not hold
+   */
+  if(RTEST(rb_hash_aref(args, rbkey_compact)))
+    rb_raise(rb_eArgError, "compact is not supported with ranges");
+  if(rb_block_given_p())
+    rb_raise(rb_eArgError, "a progress block is not supported with ranges");
+}
+
+static VALUE
+t_eval(VALUE self, VALUE args)
+{
+  rbeval_job_t job;
+
+  if(rbRangeArgs(args)) {
+    rbrange_job_t* range_job;
+
+    rbRangeCheckOptions(args);
+    range_job = ALLOC(rbrange_job_t);
+    MEMZERO(range_job, rbrange_job_t, 1);
+    range_job->args = args;
+    return rb_ensure(rbEvalRanges, (VALUE)range_job, rbEvalRangesFree, (VALUE)range_job);
+  }
+
+  if(!rbEvalArgs2Job(args, &job))
+    return 0;
+
+  return rbEvalRun(&job);
+}
+
+/*
+ * PokerEval.eval_streets takes the t_eval argument hash with the board
+ * dealt so far and "streets", the increasing numbers of board cards
+ * shown at each street, such as [0, 3, 4, 5]. It returns one t_eval
+ * result per street, as if the board was cut after that many cards,
+ * from a single exhaustive enumeration. Options that sample, stop
+ * early or report progress raise ArgumentError.
+ */
+static VALUE
+t_eval_streets(VALUE self, VALUE args)
+{
+  rbeval_job_t job;
+  VALUE rbboard = rb_hash_aref(args, rbkey_board);
+  VALUE rbstreets = rb_hash_aref(args, rbkey_streets);
+  VALUE unsupported[] = { rbkey_iterations, rbkey_deadline_ms, rbkey_stderr, rbkey_min_iterations, rbkey_max_iterations, rbkey_histogram, rbkey_histogram_street };
+  VALUE list;
+  int board_size;
+  int i;
+
+  if(TYPE(rbboard) != T_ARRAY)
+    rb_raise(rb_eArgError, "board must be a list of cards");
+  if(TYPE(rbstreets) != T_ARRAY || RARRAY_LEN(rbstreets) < 1 || RARRAY_LEN(rbstreets) > RBEVAL_MAXSTREETS)
+    rb_raise(rb_eArgError, "streets must be a list of 1 to %d numbers of board cards", RBEVAL_MAXSTREETS);
+  if(rbRangeArgs(args))
+    rb_raise(rb_eArgError, "ranges are not supported by PokerEval.eval_streets");
+  /*
+   * Every street is enumerated to the end: nothing samples, stops early
+   * or reports progress.
+   */
+  rbEvalCheckUnsupported(args, unsupported, sizeof(unsupported) / sizeof(unsupported[0]), "by PokerEval.eval_streets");
+  if(rb_block_given_p())
+    rb_raise(rb_eArgError, "a progress block is not supported by PokerEval.eval_streets");
+  if(!rbEvalArgs2Job(args, &job))
+    rb_raise(rb_eArgError, "invalid pockets or board");
+
+  board_size = RARRAY_LENINT(rbboard);
+  job.nstreets = RARRAY_LENINT(rbstreets);
+  for(i = 0; i < job.nstreets; i++) {
+    int first = i > 0 ? job.streets[i - 1] : 0;
+
+    job.streets[i] = NUM2INT(rb_ary_entry(rbstreets, i));
+    if(job.streets[i] < first || (i > 0 && job.streets[i] == first) || job.streets[i] > board_size)
+      rb_raise(rb_eArgError, "streets must increase and be at most %d", board_size);
+    if(rbList2CardMask(rb_ary_subseq(rbboard, first, job.streets[i] - first), &job.street_cards[i]) != job.streets[i] - first)
+      rb_raise(rb_eArgError, "the first %d board cards must be known", job.streets[i]);
+  }
+
+  job.board = job.street_cards[0];
+  job.numToDeal[0] = board_size - job.streets[0];
+  rbEvalJob(&job);
+
+  list = rb_ary_new2(job.nstreets);
+  for(i = 0; i < job.nstreets; i++)
+    rb_ary_push(list, rbEvalResultOf(&job, &job.street_results[i], 0));
+
+  return list;
+}
+
+/*
+ * PokerEval::Scenario.new takes the t_eval argument hash and keeps it
+ * parsed as a job, which every eval or exhaustive call copies and runs
+ * with nothing left to parse but the options it is given: board, dead,
+ * iterations and seed, as strings or symbols. Without a seed, every
+ * call samples from a new random stream. Ranges are not supported.
+ */
+static VALUE cPokerEvalScenario;
+
+static size_t
+rbScenarioSize(const void* ptr)
+{
+  return sizeof(rbeval_job_t);
+}
+
+static const rb_data_type_t rbscenario_type = {
+  "PokerEval::Scenario",
+  { 0, RUBY_TYPED_DEFAULT_FREE, rbScenarioSize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE
+rbScenarioAlloc(VALUE klass)
+{
+  rbeval_job_t* job = ALLOC(rbeval_job_t);
+
+  MEMZERO(job, rbeval_job_t, 1);
+  return TypedData_Wrap_Struct(klass, &rbscenario_type, job);
+}
+
+static rbeval_job_t*
+rbScenarioGet(VALUE self)
+{
+  rbeval_job_t* job;
+
+  TypedData_Get_Struct(self, rbeval_job_t, &rbscenario_type, job);
+  if(job->params == 0)
+    rb_raise(rb_eArgError, "scenario is not initialized");
+  return job;
+}
+
+static VALUE
+t_scenario_initialize(VALUE self, VALUE args)
+{
+  rbeval_job_t* job;
+
+  TypedData_Get_Struct(self, rbeval_job_t, &rbscenario_type, job);
+  if(rbRangeArgs(args))
+    rb_raise(rb_eArgError, "ranges are not supported by PokerEval::Scenario");
+  if(!rbEvalArgs2Job(args, job))
+    rb_raise(rb_eArgError, "invalid scenario");
+
+  return self;
+}
+
+static VALUE
+rbScenarioOption(VALUE options, VALUE key)
+{
+  VALUE value = rb_hash_lookup2(options, key, Qundef);
+
+  if(value == Qundef)
+    value = rb_hash_lookup2(options, rb_str_intern(key), Qnil);
+  return value;
+}
+
+static VALUE
+rbScenarioRun(VALUE self, VALUE options, int exhaustive)
+{
+  rbeval_job_t job = *rbScenarioGet(self);
+
+  if(!NIL_P(options)) {
+    VALUE rbboard, rbdead, rbiterations, rbseed;
+
+    Check_Type(options, T_HASH);
+    rbboard = rbScenarioOption(options, rbkey_board);
+    rbdead = rbScenarioOption(options, rbkey_dead);
+    rbiterations = rbScenarioOption(options, rbkey_iterations);
+    rbseed = rbScenarioOption(options, rbkey_seed);
+    if(!NIL_P(rbboard) && !rbEvalBoard2Job(rbboard, &job))
+      return 0;
+    if(!NIL_P(rbdead))
+      rbEvalDead2Job(rbdead, &job);
+    if(!NIL_P(rbiterations))
+      job.iterations = NUM2LL(rbiterations);
+    if(!NIL_P(rbseed)) {
+      job.seed = NUM2ULL(rbseed);
+      job.seeded = 1;
+    }
+  }
+
+  if(exhaustive) {
+    job.iterations = 0;
+    job.target_stderr = 0;
+  }
+
+  if(!job.seeded)
+    job.seed = ((uint64_t)rb_genrand_int32() << 32) | rb_genrand_int32();
+
+  return rbEvalRun(&job);
+}
+
+static VALUE
+t_scenario_eval(int argc, VALUE* argv, VALUE self)
+{
+  VALUE options;
+
+  rb_scan_args(argc, argv, "01", &options);
+  return rbScenarioRun(self, options, 0);
+}
+
+static VALUE
+t_scenario_exhaustive(int argc, VALUE* argv, VALUE self)
+{
+  VALUE options;
+
+  rb_scan_args(argc, argv, "01", &options);
+  return rbScenarioRun(self, options, 1);
+}
+
+/*
+ * Showdown of hands whose cards are all known: every player's hand is
+ * evaluated once, the way the INNER_LOOP of its game does, and the
+ * winners are found by rbenumShowdown, with nothing enumerated or
+ * counted.
+ */
+static HandVal
+rbShowdownHigh(StdDeck_CardMask hand, int ncards)
+{
+#ifdef RBEVAL_HAND_TABLE
+  if(ncards == 7 && rbhand_table.ready)
+    return rbHandEval7(hand);
+#endif
+  return StdDeck_StdRules_EVAL_N(hand, ncards);
+}
+
+/*
+ * Values of the hand of pocket with board and the RBENUM_SIDE_* of
+ * the pots game is played for.
+ */
+static int
+rbShowdownEval(enum_game_t game, StdDeck_CardMask pocket, StdDeck_CardMask board,
+               HandVal* hival, LowHandVal* loval)
+{
+  StdDeck_CardMask hand;
+  int ncards;
+
+  StdDeck_CardMask_OR(hand, pocket, board);
+  ncards = __builtin_popcountll(hand.cards_n);
+  *hival = HandVal_NOTHING;
+  *loval = LowHandVal_NOTHING;
+
+  switch(game) {
+  case game_holdem:
+  case game_7stud:
+    *hival = rbShowdownHigh(hand, ncards);
+    return RBENUM_SIDE_HI;
+  case game_holdem8:
+  case game_7stud8:
+    *hival = rbShowdownHigh(hand, ncards);
+    *loval = StdDeck_Lowball8_EVAL(hand, ncards);
+    return RBENUM_SIDE_HILO;
+  case game_omaha:
+  case game_omaha8:
+    if(StdDeck_OmahaHiLow8_EVAL(pocket, board, hival, game == game_omaha8 ? loval : NULL) != 0)
+      rb_raise(rb_eArgError, "omaha showdowns need 4 hole cards and 3 to 5 board cards");
+    return game == game_omaha8 ? RBENUM_SIDE_HILO : RBENUM_SIDE_HI;
+  case game_7studnsq:
+    *hival = rbShowdownHigh(hand, ncards);
+    *loval = StdDeck_Lowball_EVAL(hand, ncards);
+    return RBENUM_SIDE_HILO;
+  case game_razz:
+    *loval = StdDeck_Lowball_EVAL(hand, ncards);
+    return RBENUM_SIDE_LO;
+  case game_lowball27:
+    *loval = StdDeck_StdRules_EVAL_N(hand, ncards);
+    return RBENUM_SIDE_LO;
+  default:
+    rb_raise(rb_eArgError, "showdown is not implemented for this game");
+  }
+  return 0;
+}
+
+static StdDeck_CardMask
+rbShowdownCards(VALUE rbcards)
+{
+  StdDeck_CardMask cards;
+
+  if(rbList2CardMask(rbcards, &cards) != rbCardListSize(rbcards))
+    rb_raise(rb_eArgError, "showdown cards must all be known");
+  return cards;
+}
+
+/*
+ * {"hi"=>[winners], "hival"=>[values], "low"=>[winners], "loval"=>[values]}
+ * with the keys of the pots game is played for, players in the order of
+ * rbpockets. "low" is left out when no hand qualifies for it.
+ */
+static VALUE
+rbShowdown(enum_game_t game, VALUE rbpockets, VALUE rbboard)
+{
+  HandVal hival[RBENUM_LANES];
+  LowHandVal loval[RBENUM_LANES];
+  rbenum_showdown_t showdown;
+  StdDeck_CardMask board;
+  VALUE result = rb_hash_new();
+  int npockets;
+  int sides = 0;
+  int i;
+
+  if (TYPE(rbpockets) != T_ARRAY)
+    rb_raise(rb_eArgError, "pockets must be list");
+  npockets = RARRAY_LENINT(rbpockets);
+  if(npockets > ENUM_MAXPLAYERS)
+    rb_raise(rb_eArgError, "at most %d pockets are allowed", ENUM_MAXPLAYERS);
+
+  StdDeck_CardMask_RESET(board);
+  if(!NIL_P(rbboard))
+    board = rbShowdownCards(rbboard);
+  for(i = 0; i < npockets; i++)
+    sides = rbShowdownEval(game, rbShowdownCards(rb_ary_entry(rbpockets, i)), board, &hival[i], &loval[i]);
+
+  rbenumShowdown(hival, loval, npockets, sides, &showdown);
+
+  if(sides & RBENUM_SIDE_HI) {
+    VALUE winners = rb_ary_new();
+    VALUE values = rb_ary_new2(npockets);
+
+    for(i = 0; i < npockets; i++) {
+      if(showdown.hiwin & (1U << i))
+        rb_ary_push(winners, INT2FIX(i));
+      rb_ary_push(values, UINT2NUM(hival[i]));
+    }
+    rb_hash_aset(result, rbkey_hi, winners);
+    rb_hash_aset(result, rbkey_hival, values);
+  }
+  if(sides & RBENUM_SIDE_LO) {
+    VALUE values = rb_ary_new2(npockets);
+
+    for(i = 0; i < npockets; i++)
+      rb_ary_push(values, UINT2NUM(loval[i]));
+    if(showdown.lowin != 0) {
+      VALUE winners = rb_ary_new();
+
+      for(i = 0; i < npockets; i++)
+        if(showdown.lowin & (1U << i))
+          rb_ary_push(winners, INT2FIX(i));
+      rb_hash_aset(result, rbkey_low, winners);
+    }
+    rb_hash_aset(result, rbkey_loval, values);
+  }
+
+  return result;
+}
+
+static VALUE
+t_showdown(VALUE self, VALUE args)
+{
+  enum_gameparams_t* params = rbGameParams(RSTRING_PTR(rb_hash_aref(args, rbkey_game)));
+
+  return rbShowdown(params->game, rb_hash_aref(args, rbkey_pockets), rb_hash_aref(args, rbkey_board));
+}
+
+/*
+ * showdown of every [pockets, board] of args["showdowns"], all of the
+ * game args["game"].
+ */
+static VALUE
+t_showdown_many(VALUE self, VALUE args)
+{
+  enum_gameparams_t* params = rbGameParams(RSTRING_PTR(rb_hash_aref(args, rbkey_game)));
+  VALUE rbshowdowns = rb_hash_aref(args, rbkey_showdowns);
+  VALUE result;
+  int i;
+
+  if (TYPE(rbshowdowns) != T_ARRAY)
+    rb_raise(rb_eArgError, "showdowns must be list");
+
+  result = rb_ary_new2(RARRAY_LEN(rbshowdowns));
+  for(i = 0; i < RARRAY_LENINT(rbshowdowns); i++) {
+    VALUE rbshowdown = rb_ary_entry(rbshowdowns, i);
+
+    if (TYPE(rbshowdown) != T_ARRAY || RARRAY_LEN(rbshowdown) != 2)
+      rb_raise(rb_eArgError, "showdowns must be [pockets, board] lists");
+    rb_ary_push(result, rbShowdown(params->game, rb_ary_entry(rbshowdown, 0), rb_ary_entry(rbshowdown, 1)));
+  }
+
+  return result;
+}
+
+/*
+ * Scenarios of a batch are parsed and evaluated RBEVAL_BATCH_CHUNK at a
+ * time, which bounds the memory a batch needs whatever its size.
+ */
+#define RBEVAL_BATCH_CHUNK 256
+
+typedef struct {
+  VALUE scenarios;
+  VALUE results;
+  int threads;
+  rbeval_job_t* jobs;
+  int njobs;
+  int next;
+  pthread_mutex_t lock;
+  volatile int interrupted;
+} rbeval_batch_t;
+
+/*
+ * Runs without the GVL: evaluate the jobs of the current chunk, one at a
+ * time, until there is none left.
+ */
+static void*
+rbeval_batch_worker(void* ptr)
+{
+  rbeval_batch_t* batch = (rbeval_batch_t*)ptr;
+
+  for(;;) {
+    int i;
+    pthread_mutex_lock(&batch->lock);
+    i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if(i >= batch->njobs || batch->interrupted)
+      break;
+    if(batch->jobs[i].params != 0 && batch->jobs[i].err == RBENUM_INTERRUPTED)
+      rbeval_run(&batch->jobs[i]);
+  }
+
+  return 0;
+}
+
+static void*
+rbeval_batch_run(void* ptr)
+{
+  rbeval_batch_t* batch = (rbeval_batch_t*)ptr;
+  int nthreads = batch->threads < batch->njobs ? batch->threads : batch->njobs;
+  pthread_t* threads = 0;
+  int* started = 0;
+  int i;
+
+  if(nthreads > 1) {
+    threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+    started = (int*)calloc(nthreads, sizeof(int));
+    if(threads != 0 && started != 0) {
+      for(i = 1; i < nthreads; i++)
+        started[i] = pthread_create(&threads[i], 0, rbeval_batch_worker, batch) == 0;
+    }
+  }
+
+  rbeval_batch_worker(batch);
+
+  if(threads != 0 && started != 0) {
+    for(i = 1; i < nthreads; i++)
+      if(started[i])
+        pthread_join(threads[i], 0);
+  }
+  free(threads);
+  free(started);
+
+  return 0;
+}
+
+static void
+rbeval_batch_unblock(void* ptr)
+{
+  rbeval_batch_t* batch = (rbeval_batch_t*)ptr;
+  int i;
+
+  batch->interrupted = 1;
+  for(i = 0; i < batch->njobs; i++)
+    batch->jobs[i].interrupted = 1;
+}
+
+#ifndef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+static VALUE
+rbeval_batch_run_blocking(void* ptr)
+{
+  rbeval_batch_run(ptr);
+  return Qnil;
+}
+#endif
+
+/*
+ * [samples, [[scoop, winhi, losehi, tiehi, winlo, loselo, tielo, ev], ...]]
+ */
+static VALUE
+rbEvalBatchResult(rbeval_job_t* job)
+{
+  int i;
+  rbenum_result_t* cresult = &job->result;
+  VALUE list = rb_ary_new2(job->pockets_size);
+
+  for(i = 0; i < job->pockets_size; i++) {
+    rb_ary_push(list, rb_ary_new3(8,
+                                  ULL2NUM(cresult->players[i].nscoop),
+                                  ULL2NUM(cresult->players[i].nwinhi),
+                                  ULL2NUM(cresult->players[i].nlosehi),
+                                  ULL2NUM(cresult->players[i].ntiehi),
+                                  ULL2NUM(cresult->players[i].nwinlo),
+                                  ULL2NUM(cresult->players[i].nloselo),
+                                  ULL2NUM(cresult->players[i].ntielo),
+                                  INT2NUM(cresult->nsamples > 0 ? (cresult->players[i].ev / RBENUM_EV_UNIT / cresult->nsamples) * 1000 : 0)));
+  }
+
+  return rb_ary_new3(2, ULL2NUM(cresult->nsamples), list);
+}
+
+static VALUE
+rbEvalBatch(VALUE ptr)
+{
+  rbeval_batch_t* batch = (rbeval_batch_t*)ptr;
+  /*
+   * Compact rows only hold counts: what these options add to a result
+   * would be lost.
+   */
+  VALUE unsupported[] = { rbkey_histogram, rbkey_histogram_street, rbkey_streets, rbkey_deadline_ms, rbkey_progress_every };
+  int size = RARRAY_LENINT(batch->scenarios);
+  int start;
+  int i;
+
+  for(start = 0; start < size; start += RBEVAL_BATCH_CHUNK) {
+    batch->njobs = size - start < RBEVAL_BATCH_CHUNK ? size - start : RBEVAL_BATCH_CHUNK;
+
+    for(i = 0; i < batch->njobs; i++) {
+      VALUE scenario = rb_ary_entry(batch->scenarios, start + i);
+
+      Check_Type(scenario, T_HASH);
+      rbEvalCheckUnsupported(scenario, unsupported, sizeof(unsupported) / sizeof(unsupported[0]), "by PokerEval.eval_batch");
+      if(!rbEvalArgs2Job(scenario, &batch->jobs[i])) {
+        batch->jobs[i].params = 0;
+        continue;
+      }
+      /*
+       * Scenarios run batch->threads at a time: their own threads are
+       * capped so that the batch starts at most RBEVAL_MAXTHREADS.
+       */
+      if(batch->jobs[i].threads > RBEVAL_MAXTHREADS / batch->threads)
+        batch->jobs[i].threads = RBEVAL_MAXTHREADS / batch->threads;
+      if(!rbPreflopFetch(&batch->jobs[i]))
+        rbCacheFetch(&batch->jobs[i]);
+    }
+
+    /*
+     * A job left with RBENUM_INTERRUPTED was interrupted or never
+     * started: handle pending interrupts and run those jobs again, the
+     * ones that finished are kept.
+     */
+    for(i = 0; i < batch->njobs; i++) {
+      if(!batch->jobs[i].cached)
+        batch->jobs[i].err = RBENUM_INTERRUPTED;
+    }
+    for(;;) {
+      int interrupted = 0;
+      batch->next = 0;
+      batch->interrupted = 0;
+      for(i = 0; i < batch->njobs; i++) {
+        if(batch->jobs[i].err == RBENUM_INTERRUPTED)
+          batch->jobs[i].interrupted = 0;
+      }
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+      rb_thread_call_without_gvl(rbeval_batch_run, batch, rbeval_batch_unblock, batch);
+#else
+      rb_thread_blocking_region(rbeval_batch_run_blocking, batch, rbeval_batch_unblock, batch);
+#endif
+      for(i = 0; i < batch->njobs; i++) {
+        if(batch->jobs[i].params != 0 && batch->jobs[i].err == RBENUM_INTERRUPTED)
+          interrupted = 1;
+      }
+      if(!interrupted)
+        break;
+      rb_thread_check_ints();
+    }
+
+    for(i = 0; i < batch->njobs; i++) {
+      rbeval_job_t* job = &batch->jobs[i];
+      if(job->params == 0) {
+        rb_ary_push(batch->results, Qnil);
+        continue;
+      }
+      if(job->err != 0)
+        rb_raise(rb_eArgError, "poker-eval: rbenum returned error code %d for scenario %d", job->err, start + i);
+      rbCacheStore(job);
+      rb_ary_push(batch->results, rbEvalBatchResult(job));
+    }
+  }
+
+  return batch->results;
+}
+
+static VALUE
+rbEvalBatchFree(VALUE ptr)
+{
+  rbeval_batch_t* batch = (rbeval_batch_t*)ptr;
+
+  xfree(batch->jobs);
+  pthread_mutex_destroy(&batch->lock);
+
+  return Qnil;
+}
+
+/*
+ * PokerEval.eval_batch(scenarios, "threads" => n) evaluates every
+ * scenario, each one a t_eval argument hash, spreading them over n
+ * threads. Returns one compact result per scenario, see
+ * rbEvalBatchResult.
+ */
+static VALUE
+t_eval_batch(int argc, VALUE* argv, VALUE self)
+{
+  VALUE rbscenarios = 0;
+  VALUE rboptions = 0;
+  rbeval_batch_t batch;
+
+  rb_scan_args(argc, argv, "11", &rbscenarios, &rboptions);
+
+  if (TYPE(rbscenarios) != T_ARRAY)
+    rb_raise(rb_eTypeError, "scenarios must be list");
+
+  memset(&batch, '\0', sizeof(rbeval_batch_t));
+  batch.scenarios = rbscenarios;
+  batch.results = rb_ary_new2(RARRAY_LEN(rbscenarios));
+  batch.threads = 1;
+
+  if(!NIL_P(rboptions)) {
+    VALUE rbthreads;
+    if (TYPE(rboptions) != T_HASH)
+      rb_raise(rb_eTypeError, "eval_batch options must be a hash");
+    rbthreads = rb_hash_aref(rboptions, rbkey_threads);
+    if(NIL_P(rbthreads))
+      rbthreads = rb_hash_aref(rboptions, ID2SYM(rb_intern("threads")));
+    if(!NIL_P(rbthreads)) {
+      batch.threads = NUM2INT(rbthreads);
+      if(batch.threads < 1 || batch.threads > RBEVAL_MAXTHREADS)
+        rb_raise(rb_eArgError, "threads must be between 1 and %d", RBEVAL_MAXTHREADS);
+    }
+  }
+
+  batch.jobs = ALLOC_N(rbeval_job_t, RBEVAL_BATCH_CHUNK);
+  pthread_mutex_init(&batch.lock, 0);
+
+  return rb_ensure(rbEvalBatch, (VALUE)&batch, rbEvalBatchFree, (VALUE)&batch);
+}
+
+/*
+ * PokerEval.cache_size = n keeps the results of the last n distinct
+ * scenarios, 0 (the default) disables the cache.
+ */
+static VALUE
+t_set_cache_size(VALUE self, VALUE rbsize)
+{
+  int size = NUM2INT(rbsize);
+
+  if(size < 0)
+    rb_raise(rb_eArgError, "cache size must not be negative");
+  rbCacheResize(size);
+
+  return rbsize;
+}
+
+static VALUE
+t_cache_size(VALUE self)
+{
+  return INT2NUM(rbcache.capacity);
+}
+
+static VALUE
+t_cache_stats(VALUE self)
+{
+  VALUE result = rb_hash_new();
+
+  rb_hash_aset(result, rbkey_capacity, INT2NUM(rbcache.capacity));
+  rb_hash_aset(result, rbkey_entries, INT2NUM(rbcache.size));
+  rb_hash_aset(result, rbkey_hits, ULONG2NUM(rbcache.hits));
+  rb_hash_aset(result, rbkey_misses, ULONG2NUM(rbcache.misses));
+
+  return result;
+}
+
+static VALUE
+t_cache_clear(VALUE self)
+{
+  rbCacheClear();
+
+  return Qnil;
+}
+
+/*
+ * PokerEval.load_preflop_table(path) maps a table written by
+ * generate_preflop_table; matching scenarios are then answered from it.
+ * nil unloads the current table.
+ */
+static VALUE
+t_load_preflop_table(VALUE self, VALUE rbpath)
+{
+  rbpreflop_t table;
+  struct stat st;
+  int fd;
+
+  rbPreflopUnload();
+  if(NIL_P(rbpath))
+    return Qnil;
+
+  memset(&table, '\0', sizeof(rbpreflop_t));
+  fd = open(StringValueCStr(rbpath), O_RDONLY);
+  if(fd < 0)
+    rb_sys_fail(StringValueCStr(rbpath));
+  if(fstat(fd, &st) < 0) {
+    close(fd);
+    rb_sys_fail(StringValueCStr(rbpath));
+  }
+  table.size = st.st_size;
+  if(table.size < sizeof(rbpreflop_header_t)) {
+    close(fd);
+    rb_raise(rb_eArgError, "%s is not a preflop table", StringValueCStr(rbpath));
+  }
+  table.map = mmap(0, table.size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(table.map == MAP_FAILED)
+    rb_sys_fail(StringValueCStr(rbpath));
+
+  table.header = (rbpreflop_header_t*)table.map;
+  table.entries = (rbpreflop_entry_t*)(table.header + 1);
+  if(memcmp(table.header->magic, RBPREFLOP_MAGIC, sizeof(table.header->magic)) ||
+     table.header->version != RBPREFLOP_VERSION ||
+     table.header->entry_size != sizeof(rbpreflop_entry_t) ||
+     table.size < sizeof(rbpreflop_header_t) + (size_t)table.header->nentries * sizeof(rbpreflop_entry_t)) {
+    munmap(table.map, table.size);
+    rb_raise(rb_eArgError, "%s is not a version %d preflop table", StringValueCStr(rbpath), RBPREFLOP_VERSION);
+  }
+
+  rbpreflop = table;
+
+  return INT2NUM(table.header->nentries);
+}
+
+static int
+rbPreflopCompareKeys(const void* a, const void* b)
+{
+  uint32_t ka = *(const uint32_t*)a;
+  uint32_t kb = *(const uint32_t*)b;
+
+  return (ka > kb) - (ka < kb);
+}
+
+/*
+ * Build a job evaluating the matchup of the two pockets in mask.
+ */
+static void
+rbPreflopJob(rbeval_job_t* job, StdDeck_CardMask first, StdDeck_CardMask second, int threads)
+{
+  memset(job, '\0', sizeof(rbeval_job_t));
+  job->params = enumGameParams(game_holdem);
+  job->pockets_size = 2;
+  job->pockets[0] = first;
+  job->pockets[1] = second;
+  job->numToDeal[0] = 5;
+  job->threads = threads;
+  job->canonical = 1;
+}
+
+typedef struct {
+  char* path;
+  int threads;
+  uint32_t* keys;
+  FILE* out;
+} rbpreflop_generator_t;
+
+static VALUE
+rbPreflopGenerate(VALUE ptr)
+{
+  rbpreflop_generator_t* generator = (rbpreflop_generator_t*)ptr;
+  rbpreflop_header_t header;
+  rbeval_job_t job;
+  size_t nkeys = 0;
+  size_t i, n;
+  int a, b, c, d;
+
+  /*
+   * Canonical key of every unordered pair of disjoint pockets
+   */
+  generator->keys = ALLOC_N(uint32_t, 1326 * 1225 / 2);
+  for(a = 0; a < StdDeck_N_CARDS; a++)
+    for(b = a + 1; b < StdDeck_N_CARDS; b++)
+      for(c = a + 1; c < StdDeck_N_CARDS; c++)
+        for(d = c + 1; d < StdDeck_N_CARDS; d++) {
+          StdDeck_CardMask first, second;
+          if(c == b || d == b)
+            continue;
+          StdDeck_CardMask_RESET(first);
+          StdDeck_CardMask_SET(first, a);
+          StdDeck_CardMask_SET(first, b);
+          StdDeck_CardMask_RESET(second);
+          StdDeck_CardMask_SET(second, c);
+          StdDeck_CardMask_SET(second, d);
+          rbPreflopJob(&job, first, second, 1);
+          rbCacheKey(&job, &job.cache_key, job.cache_order);
+          generator->keys[nkeys++] = rbPreflopKey(&job.cache_key);
+        }
+
+  qsort(generator->keys, nkeys, sizeof(uint32_t), rbPreflopCompareKeys);
+  for(i = n = 0; i < nkeys; i++) {
+    if(n == 0 || generator->keys[n - 1] != generator->keys[i])
+      generator->keys[n++] = generator->keys[i];
+  }
+
+  generator->out = fopen(generator->path, "wb");
+  if(generator->out == 0)
+    rb_sys_fail(generator->path);
+
+  memset(&header, '\0', sizeof(rbpreflop_header_t));
+  memcpy(header.magic, RBPREFLOP_MAGIC, sizeof(header.magic));
+  header.version = RBPREFLOP_VERSION;
+  header.entry_size = sizeof(rbpreflop_entry_t);
+  header.nentries = n;
+  if(fwrite(&header, sizeof(header), 1, generator->out) != 1)
+    rb_sys_fail(generator->path);
+
+  for(i = 0; i < n; i++) {
+    rbpreflop_entry_t entry;
+    StdDeck_CardMask first, second;
+    uint32_t key = generator->keys[i];
+
+    StdDeck_CardMask_RESET(first);
+    StdDeck_CardMask_SET(first, key & 63);
+    StdDeck_CardMask_SET(first, (key >> 6) & 63);
+    StdDeck_CardMask_RESET(second);
+    StdDeck_CardMask_SET(second, (key >> 12) & 63);
+    StdDeck_CardMask_SET(second, (key >> 18) & 63);
+    rbPreflopJob(&job, first, second, generator->threads);
+    rbEvalJob(&job);
+
+    entry.key = key;
+    entry.win = job.result.players[0].nwinhi;
+    entry.tie = job.result.players[0].ntiehi;
+    entry.lose = job.result.players[0].nlosehi;
+    header.nsamples = job.result.nsamples;
+    if(fwrite(&entry, sizeof(entry), 1, generator->out) != 1)
+      rb_sys_fail(generator->path);
+  }
+
+  /*
+   * nsamples is only known once a matchup has been enumerated
+   */
+  if(fseek(generator->out, 0, SEEK_SET) != 0 ||
+     fwrite(&header, sizeof(header), 1, generator->out) != 1)
+    rb_sys_fail(generator->path);
+
+  return INT2NUM(n);
+}
+
+static VALUE
+rbPreflopGenerateEnsure(VALUE ptr)
+{
+  rbpreflop_generator_t* generator = (rbpreflop_generator_t*)ptr;
+
+  xfree(generator->keys);
+  if(generator->out != 0)
+    fclose(generator->out);
+
+  return Qnil;
+}
+
+/*
+ * PokerEval.generate_preflop_table(path, threads = 1) enumerates every
+ * heads-up holdem preflop matchup, up to suit isomorphism, and writes
+ * the table load_preflop_table maps. This takes a long time.
+ */
+static VALUE
+t_generate_preflop_table(int argc, VALUE* argv, VALUE self)
+{
+  VALUE rbpath = 0;
+  VALUE rbthreads = 0;
+  rbpreflop_generator_t generator;
+
+  rb_scan_args(argc, argv, "11", &rbpath, &rbthreads);
+
+  memset(&generator, '\0', sizeof(rbpreflop_generator_t));
+  generator.path = StringValueCStr(rbpath);
+  generator.threads = NIL_P(rbthreads) ? 1 : NUM2INT(rbthreads);
+  if(generator.threads < 1 || generator.threads > RBEVAL_MAXTHREADS)
+    rb_raise(rb_eArgError, "threads must be between 1 and %d", RBEVAL_MAXTHREADS);
+
+  return rb_ensure(rbPreflopGenerate, (VALUE)&generator, rbPreflopGenerateEnsure, (VALUE)&generator);
+}
+
+VALUE cPokerEval;
+
+void
+Init_poker_eval_api()
+{
+    cPokerEval = rb_define_class("PokerEval", rb_cObject);
+    rb_define_singleton_method(cPokerEval, "eval", t_eval, 1);
+    rb_define_singleton_method(cPokerEval, "eval_streets", t_eval_streets, 1);
+    rb_define_singleton_method(cPokerEval, "eval_hand", t_eval_hand, 1);
+    rb_define_singleton_method(cPokerEval, "eval_hand_many", t_eval_hand_many, 1);
+    rb_define_singleton_method(cPokerEval, "eval_batch", t_eval_batch, -1);
+    rb_define_singleton_method(cPokerEval, "showdown", t_showdown, 1);
+    rb_define_singleton_method(cPokerEval, "showdown_many", t_showdown_many, 1);
+    rb_define_singleton_method(cPokerEval, "cache_size", t_cache_size, 0);
+    rb_define_singleton_method(cPokerEval, "cache_size=", t_set_cache_size, 1);
+    rb_define_singleton_method(cPokerEval, "cache_stats", t_cache_stats, 0);
+    rb_define_singleton_method(cPokerEval, "cache_clear", t_cache_clear, 0);
+    rb_define_singleton_method(cPokerEval, "load_preflop_table", t_load_preflop_table, 1);
+    rb_define_singleton_method(cPokerEval, "generate_preflop_table", t_generate_preflop_table, -1);
+
+    cPokerEvalResult = rb_define_class_under(cPokerEval, "Result", rb_cObject);
+    rb_undef_alloc_func(cPokerEvalResult);
+    rb_define_method(cPokerEvalResult, "samples", t_result_samples, 0);
+    rb_define_method(cPokerEvalResult, "size", t_result_size, 0);
+    rb_define_method(cPokerEvalResult, "haslopot", t_result_haslopot, 0);
+    rb_define_method(cPokerEvalResult, "hashipot", t_result_hashipot, 0);
+    rb_define_method(cPokerEvalResult, "scoop", t_result_scoop, 1);
+    rb_define_method(cPokerEvalResult, "winhi", t_result_winhi, 1);
+    rb_define_method(cPokerEvalResult, "losehi", t_result_losehi, 1);
+    rb_define_method(cPokerEvalResult, "tiehi", t_result_tiehi, 1);
+    rb_define_method(cPokerEvalResult, "winlo", t_result_winlo, 1);
+    rb_define_method(cPokerEvalResult, "loselo", t_result_loselo, 1);
+    rb_define_method(cPokerEvalResult, "tielo", t_result_tielo, 1);
+    rb_define_method(cPokerEvalResult, "ev", t_result_ev, 1);
+    rb_define_method(cPokerEvalResult, "to_h", t_result_to_h, 0);
+
+    cPokerEvalScenario = rb_define_class_under(cPokerEval, "Scenario", rb_cObject);
+    rb_define_alloc_func(cPokerEvalScenario, rbScenarioAlloc);
+    rb_define_method(cPokerEvalScenario, "initialize", t_scenario_initialize, 1);
+    rb_define_method(cPokerEvalScenario, "eval", t_scenario_eval, -1);
+    rb_define_method(cPokerEvalScenario, "exhaustive", t_scenario_exhaustive, -1);
+
+    rbCacheInitPerms();
+#ifdef RBEVAL_AVX2
+    __builtin_cpu_init();
+    rbeval_avx2 = __builtin_cpu_supports("avx2");
+#endif
+#ifdef RBEVAL_HAND_TABLE
+    rbHandTableInit();
+#endif
+
+    rbInternKey(&rbkey_game, "game");
+    rbInternKey(&rbkey_pockets, "pockets");
+    rbInternKey(&rbkey_board, "board");
+    rbInternKey(&rbkey_dead, "dead");
+    rbInternKey(&rbkey_iterations, "iterations");
+    rbInternKey(&rbkey_threads, "threads");
+    rbInternKey(&rbkey_seed, "seed");
+    rbInternKey(&rbkey_canonical, "canonical");
+    rbInternKey(&rbkey_stderr, "stderr");
+    rbInternKey(&rbkey_min_iterations, "min_iterations");
+    rbInternKey(&rbkey_max_iterations, "max_iterations");
+    rbInternKey(&rbkey_deadline_ms, "deadline_ms");
+    rbInternKey(&rbkey_progress_every, "progress_every");
+    rbInternKey(&rbkey_compact, "compact");
+    rbInternKey(&rbkey_histogram, "histogram");
+    rbInternKey(&rbkey_histogram_street, "histogram_street");
+    rbInternKey(&rbkey_streets, "streets");
+
+    rbInternKey(&rbkey_info, "info");
+    rbInternKey(&rbkey_eval, "eval");
+    rbInternKey(&rbkey_samples, "samples");
+    rbInternKey(&rbkey_haslopot, "haslopot");
+    rbInternKey(&rbkey_hashipot, "hashipot");
+    rbInternKey(&rbkey_partial, "partial");
+    rbInternKey(&rbkey_scoop, "scoop");
+    rbInternKey(&rbkey_winhi, "winhi");
+    rbInternKey(&rbkey_losehi, "losehi");
+    rbInternKey(&rbkey_tiehi, "tiehi");
+    rbInternKey(&rbkey_winlo, "winlo");
+    rbInternKey(&rbkey_loselo, "loselo");
+    rbInternKey(&rbkey_tielo, "tielo");
+    rbInternKey(&rbkey_ev, "ev");
+    rbInternKey(&rbkey_runouts, "runouts");
+    rbInternKey(&rbkey_ehs2, "ehs2");
+    rbInternKey(&rbkey_exact, "exact");
+
+    rbInternKey(&rbkey_showdowns, "showdowns");
+    rbInternKey(&rbkey_hi, "hi");
+    rbInternKey(&rbkey_low, "low");
+    rbInternKey(&rbkey_hival, "hival");
+    rbInternKey(&rbkey_loval, "loval");
+
+    rbInternKey(&rbkey_capacity, "capacity");
+    rbInternKey(&rbkey_entries, "entries");
+    rbInternKey(&rbkey_hits, "hits");
+    rbInternKey(&rbkey_misses, "misses");
 }
 
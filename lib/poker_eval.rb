@@ -38,6 +38,20 @@ class PokerEval
     results
   end
 
+  def self.best_many args
+    self.eval_hand_many(args).each do |results|
+      results["combination"].each_with_index do |i, index|
+        if index > 0
+          results["combination"][index] = card2string(i)
+        end
+      end
+    end
+  end
+
+  def self.known_cards? cards
+    cards.is_a?(Integer) || (cards.is_a?(Array) && !cards.include?("__") && !cards.include?(255))
+  end
+
   def self.winner args
     index2index = {}
     normalized_pockets = []
@@ -46,12 +60,12 @@ class PokerEval
 
     pockets.each_with_index do |pocket, index|
       if !args["fill_pockets"]
-        if pocket.find_index("__")
+        if pocket.is_a?(Array) && (pocket.include?("__") || pocket.include?(255))
           pockets[index] = []
         end
       end
 
-      if !pockets[index].empty?
+      if pockets[index] != [] && pockets[index] != 0
         normalized_pockets << pockets[index]
         index2index[index] = normalized_index
         normalized_index += 1
@@ -59,6 +73,18 @@ class PokerEval
     end
 
     args["pockets"] = normalized_pockets
+
+    if ([args["board"]] + normalized_pockets).all? { |cards| known_cards?(cards) }
+      results = self.showdown(args)
+      winners = { 'low' => [], 'hi' => [] }
+      index2index.each do |index, normalized|
+        winners["low"] << index if results["low"] && results["low"].include?(normalized)
+        winners["hi"] << index if results["hi"] && results["hi"].include?(normalized)
+      end
+      winners.delete("low") if winners["low"].empty?
+      return winners
+    end
+
     results = self.eval(args)
 
 
@@ -92,3 +118,7 @@ class PokerEval
 
   end
 end
+
+if ENV['POKER_EVAL_PREFLOP_TABLE']
+  PokerEval.load_preflop_table(ENV['POKER_EVAL_PREFLOP_TABLE'])
+end
@@ -3,9 +3,49 @@
 
 require "test/unit"
 require 'ostruct'
+require 'timeout'
+require 'tempfile'
 require "poker_eval"
 
 class TC_PokerEval < Test::Unit::TestCase
+  DECK = (0...52).map { |index| PokerEval.card2string(index) }
+
+  # count deals of size cards each out of deck, the same for a given seed
+  def random_deals(seed, count, size, deck = DECK)
+    random = Random.new(seed)
+    (0...count).map { deck.sample(size, random: random) }
+  end
+
+  # the win, tie and lose counts of each player of a single showdown given
+  # the eval_hand value of their hand on the side, the highest hi or the
+  # lowest low winning; nil values have no low and count nothing
+  def showdown_counts(values, side)
+    qualified = values.compact
+    best = side == "hi" ? qualified.max : qualified.min
+    values.map do |value|
+      counts = {"win#{side}"=>0, "tie#{side}"=>0, "lose#{side}"=>0}
+      if value.nil?
+      elsif value != best
+        counts["lose#{side}"] = 1
+      else
+        counts[qualified.count(best) == 1 ? "win#{side}" : "tie#{side}"] = 1
+      end
+      counts
+    end
+  end
+
+  # the counts of eval for every river dealt to board, added up
+  def river_sums(game, pockets, board, counts)
+    used = pockets.flatten + board
+    expect = [[0] * counts.size] * pockets.size
+    DECK.each do |river|
+      next if used.any? { |card| card.casecmp?(river) }
+      result = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board + [river]})
+      expect = expect.zip(result["eval"]).map { |sums, e| sums.zip(e.values_at(*counts)).map { |a, b| a + b } }
+    end
+    expect
+  end
+
   def test_eval()
     pockets = [["tc", "ac"],  ["th", "ah"],  ["8c", "6h"]]
     board = ["7h","3s", "2c", "7s", "7d"]
@@ -15,6 +55,444 @@ class TC_PokerEval < Test::Unit::TestCase
     assert_equal(result, expect);
   end
 
+  def test_eval_threads()
+    pockets = [["ac", "2c"], ["ad", "3h"], ["kh", "ks"]]
+    board = ["4d", "5s", "9c", "__", "__"]
+    game = "holdem8"
+    single = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board})
+    threaded = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board, "threads"=>3})
+    assert_equal(single, threaded)
+    assert_equal(903, threaded["info"]["samples"])
+    assert_raise(ArgumentError) { PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board, "threads"=>0}) }
+    assert_raise(TypeError) { PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board, "threads"=>"3"}) }
+  end
+
+  def test_eval_counts()
+    pockets = [["as", "2s"], ["3h", "4d"], ["kc", "kd"]]
+    board = ["__", "__", "__", "__", "__"]
+    game = "holdem8"
+    result = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board, "iterations"=>50000, "seed"=>7, "threads"=>4})
+    samples = result["info"]["samples"]
+    assert_equal(50000, samples)
+    result["eval"].each do |player|
+      assert_equal(samples, player["winhi"] + player["tiehi"] + player["losehi"])
+      assert_operator(player["winlo"] + player["tielo"] + player["loselo"], :<, samples)
+      assert_operator(player["scoop"], :<=, player["winhi"])
+    end
+    assert_in_delta(1000, result["eval"].map { |player| player["ev"] }.inject(:+), 3)
+  end
+
+  def test_eval_card_indices()
+    index = lambda { |card| card == "__" ? 255 : (0..51).find { |i| PokerEval.card2string(i).downcase == card } }
+    mask = lambda { |cards| cards.inject(0) { |bits, card| bits | (1 << index.call(card)) } }
+    pockets = [["ac", "2c"], ["ad", "3h"], ["kh", "ks"]]
+    board = ["4d", "5s", "9c", "__", "__"]
+    game = "holdem8"
+    expect = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board})
+    indices = pockets.map { |pocket| pocket.map(&index) }
+    assert_equal(expect, PokerEval.eval({"game"=>game, "pockets"=>indices, "board"=>board.map(&index)}))
+    masks = pockets.map(&mask)
+    assert_equal(expect, PokerEval.eval({"game"=>game, "pockets"=>masks, "board"=>board.map(&index)}))
+    river = ["4d", "5s", "9c", "jd", "2h"]
+    assert_equal(PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>river}),
+                 PokerEval.eval({"game"=>game, "pockets"=>masks, "board"=>mask.call(river)}))
+    hand = ["Ac", "As", "Td", "7s", "7h", "3s", "2c"]
+    assert_equal(PokerEval.eval_hand({"side"=>"hi", "hand"=>hand}),
+                 PokerEval.eval_hand({"side"=>"hi", "hand"=>mask.call(hand.map(&:downcase))}))
+    assert_raise(ArgumentError) { PokerEval.eval({"game"=>game, "pockets"=>[[12, 52], indices[1]], "board"=>board}) }
+    assert_raise(ArgumentError) { PokerEval.eval({"game"=>game, "pockets"=>[[12, 2 ** 32 + 1], indices[1]], "board"=>board}) }
+    assert_raise(ArgumentError) { PokerEval.eval({"game"=>game, "pockets"=>[1 << 52, masks[1]], "board"=>board}) }
+  end
+
+  def test_eval_compact()
+    args = {"game"=>"holdem8", "pockets"=>[["ac", "2c"], ["ad", "3h"], ["kh", "ks"]], "board"=>["4d", "5s", "9c", "__", "__"]}
+    expect = PokerEval.eval(args)
+    result = PokerEval.eval(args.merge("compact"=>true))
+    assert_kind_of(PokerEval::Result, result)
+    assert_equal(expect, result.to_h)
+    assert_equal(903, result.samples)
+    assert_equal(3, result.size)
+    assert_equal(1, result.haslopot)
+    expect["eval"].each_with_index do |player, i|
+      %w(scoop winhi losehi tiehi winlo loselo tielo).each { |key| assert_equal(player[key], result.send(key, i)) }
+      assert_equal(player["ev"], result.ev(i).to_i)
+    end
+    assert_in_delta(1000, (0...result.size).map { |i| result.ev(i) }.inject(:+), 1e-9)
+    assert_raise(IndexError) { result.winhi(3) }
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("pockets"=>["AA", "KK"], "game"=>"holdem", "compact"=>true)) }
+  end
+
+  def test_eval_scenario()
+    pockets = [["ac", "2c"], ["ad", "3h"], ["kh", "ks"]]
+    args = {"game"=>"holdem8", "pockets"=>pockets, "board"=>["__", "__", "__", "__", "__"], "seed"=>11}
+    scenario = PokerEval::Scenario.new(args)
+    [["4d", "5s", "9c", "__", "__"], ["4d", "5s", "9c", "jd", "2h"]].each do |board|
+      expect = PokerEval.eval(args.merge("board"=>board))
+      assert_equal(expect, scenario.eval("board"=>board))
+      assert_equal(expect, scenario.eval(board: board))
+      assert_equal(expect, scenario.exhaustive(board: board, iterations: 1000))
+    end
+    assert_equal(PokerEval.eval(args.merge("iterations"=>5000)), scenario.eval(iterations: 5000))
+    assert_equal(5000, scenario.eval(iterations: 5000)["info"]["samples"])
+    assert_raise(ArgumentError) { PokerEval::Scenario.new(args.merge("pockets"=>["AA", "KK"])) }
+  end
+
+  def test_eval_seed()
+    pockets = [["as", "ah"], ["ks", "kh"], ["__", "__"]]
+    board = ["__", "__", "__", "__", "__"]
+    game = "holdem"
+    args = {"game"=>game, "pockets"=>pockets, "board"=>board, "iterations"=>20000, "seed"=>1234, "threads"=>4}
+    result = PokerEval.eval(args)
+    assert_equal(result, PokerEval.eval(args))
+    assert_equal(20000, result["info"]["samples"])
+  end
+
+  def test_eval_stderr()
+    args = {"game"=>"holdem", "pockets"=>[["as", "ah"], ["7c", "2d"]], "board"=>["__", "__", "__", "__", "__"], "stderr"=>2, "seed"=>5, "threads"=>2}
+    result = PokerEval.eval(args)
+    assert_operator(result["info"]["stderr"], :<=, 2)
+    assert_operator(result["info"]["samples"], :>=, 10000)
+    assert_equal(result, PokerEval.eval(args))
+    result = PokerEval.eval(args.merge("stderr"=>0.001, "max_iterations"=>25000))
+    assert_equal(25000, result["info"]["samples"])
+    assert_operator(result["info"]["stderr"], :>, 0.001)
+    # a single block says nothing of the error
+    result = PokerEval.eval(args.merge("min_iterations"=>10, "max_iterations"=>10, "threads"=>1))
+    assert_equal(10, result["info"]["samples"])
+    assert_nil(result["info"]["stderr"])
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("stderr"=>0)) }
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("min_iterations"=>20, "max_iterations"=>10)) }
+  end
+
+  def test_eval_deadline()
+    args = {"game"=>"holdem", "pockets"=>[["as", "ah"], ["kd", "kc"]], "board"=>["__", "__", "__", "__", "__"], "deadline_ms"=>20}
+    [100000000, 2 ** 40].each do |iterations|
+      result = PokerEval.eval(args.merge("iterations"=>iterations))
+      assert_equal(1, result["info"]["partial"])
+      assert_operator(result["info"]["samples"], :<, iterations)
+    end
+    result = PokerEval.eval(args.merge("board"=>["2c", "3c", "4d", "__", "__"]))
+    assert_equal(0, result["info"]["partial"])
+    assert_equal(990, result["info"]["samples"])
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("deadline_ms"=>0)) }
+    # an enumeration stopped part way through its runouts is not returned:
+    # the first boards dealt favor the aces
+    result = PokerEval.eval(args.merge("deadline_ms"=>100, "threads"=>4))
+    assert_in_delta(812, result["eval"][0]["ev"], 15) if result["info"]["samples"] >= 10000
+  end
+
+  def test_eval_progress()
+    args = {"game"=>"holdem", "pockets"=>[["as", "ah"], ["kd", "kc"]], "board"=>["2c", "3c", "4d", "__", "__"], "progress_every"=>100}
+    samples = []
+    result = PokerEval.eval(args) { |snapshot| samples << snapshot["info"]["samples"]; nil }
+    samples.each { |count| assert_equal(0, count % 100) }
+    assert_equal(samples.sort.uniq, samples)
+    assert_equal(PokerEval.eval(args)["eval"], result["eval"])
+    assert_equal(0, result["info"]["partial"])
+    args["board"] = ["__", "__", "__", "__", "__"]
+    result = PokerEval.eval(args) { |snapshot| :stop }
+    assert_equal(1, result["info"]["partial"])
+    assert_operator(result["info"]["samples"], :<, 1712304)
+    # modes that can not report progress refuse a block
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("stderr"=>2)) { |snapshot| :stop } }
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("pockets"=>["AA", "KK"])) { |snapshot| :stop } }
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("progress_every"=>0)) { |snapshot| nil } }
+  end
+
+  def test_eval_hand_table()
+    # 7 card showdowns agree with eval_hand, which evaluates hands with poker-eval
+    random_deals(42, 1000, 14).each do |cards|
+      pockets = [cards[0, 7], cards[7, 7]]
+      result = PokerEval.eval({"game"=>"7stud", "pockets"=>pockets, "board"=>[]})
+      values = pockets.map { |hand| PokerEval.eval_hand({"side"=>"hi", "hand"=>hand})["value"] }
+      assert_equal(showdown_counts(values, "hi"), result["eval"].map { |e| e.slice("winhi", "tiehi", "losehi") })
+    end
+  end
+
+  def test_eval_incremental()
+    # dealing the river to known pockets adds up to every river evaluated alone
+    pockets = [["ac", "2c"], ["ad", "3h"], ["kh", "ks"]]
+    board = ["4d", "5s", "9c", "kc"]
+    counts = ["scoop", "winhi", "losehi", "tiehi", "winlo", "loselo", "tielo"]
+    expect = river_sums("holdem8", pockets, board, counts)
+    result = PokerEval.eval({"game"=>"holdem8", "pockets"=>pockets, "board"=>board + ["__"]})
+    assert_equal(42, result["info"]["samples"])
+    assert_equal(expect, result["eval"].map { |e| e.values_at(*counts) })
+  end
+
+  def test_eval_player_kernels()
+    # every player count has its own kernel, 11 players the generic one
+    counts = ["scoop", "winhi", "losehi", "tiehi"]
+    (2..11).each do |nplayers|
+      cards = random_deals(nplayers, 1, 2 * nplayers + 4)[0]
+      pockets = cards[0, 2 * nplayers].each_slice(2).to_a
+      board = cards[2 * nplayers, 4]
+      expect = river_sums("holdem", pockets, board, counts)
+      result = PokerEval.eval({"game"=>"holdem", "pockets"=>pockets, "board"=>board + ["__"]})
+      assert_equal(expect, result["eval"].map { |e| e.values_at(*counts) })
+    end
+  end
+
+  def test_eval_showdown()
+    # twelve players fill both halves of the vector compares
+    royal = ["As", "Ks", "Qs", "Js", "Ts"]
+    deals = random_deals(7, 1, 24, DECK - royal).map { |cards| cards + royal } + random_deals(7, 300, 29)
+    deals.each do |cards|
+      pockets = cards[0, 24].each_slice(2).to_a
+      board = cards[24, 5]
+      values = pockets.map { |pocket| PokerEval.eval_hand({"side"=>"hi", "hand"=>pocket + board})["value"] }
+      result = PokerEval.eval({"game"=>"holdem", "pockets"=>pockets, "board"=>board})
+      assert_equal(showdown_counts(values, "hi"), result["eval"].map { |e| e.slice("winhi", "tiehi", "losehi") })
+    end
+  end
+
+  def test_eval_omaha()
+    # known omaha pockets agree with eval_hand, which goes through OmahaHiLow8_Best
+    lows = ["2c", "3d", "5h", "7s", "8c"]
+    deals = random_deals(11, 200, 21)
+    # boards with three low cards, most of them making a low for someone
+    deals += random_deals(12, 100, 18, DECK - lows).each_with_index.map { |cards, i| cards + lows.rotate(i).first(3) }
+    deals.each do |cards|
+      pockets = cards[0, 16].each_slice(4).to_a
+      board = cards[16, 5]
+      hi = pockets.map { |pocket| PokerEval.eval_hand({"side"=>"hi", "hand"=>pocket, "board"=>board})["value"] }
+      low = pockets.map { |pocket| PokerEval.eval_hand({"side"=>"low", "hand"=>pocket, "board"=>board})["value"] }
+      low = low.map { |value| value == 0x0FFFFFFF ? nil : value }
+      ["omaha", "omaha8"].each do |game|
+        result = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board})
+        split = game == "omaha8" && low.any?
+        expect = showdown_counts(hi, "hi").zip(showdown_counts(split ? low : [nil] * low.size, "lo")).map do |hicounts, lowcounts|
+          counts = hicounts.merge(lowcounts)
+          counts.merge("scoop"=>counts["winhi"] == 1 && (!split || counts["winlo"] == 1) ? 1 : 0)
+        end
+        assert_equal(expect, result["eval"].map { |e| e.slice(*expect[0].keys) })
+      end
+    end
+  end
+
+  def test_eval_no_low_board()
+    # boards at the edge of three low ranks, below which no low is evaluated:
+    # an ace counts as low, a paired low rank only once
+    boards = {["ac", "2d", "7h", "kc", "ks"]=>true, ["3c", "5d", "8h", "9c", "ts"]=>true,
+              ["2c", "2d", "7h", "kc", "ks"]=>false, ["ac", "ad", "8h", "9c", "ts"]=>false}
+    games = {"holdem8"=>[["as", "2s"], ["4h", "6d"]], "omaha8"=>[["as", "2s", "kh", "kd"], ["4h", "6d", "qc", "qd"]]}
+    boards.each do |board, haslow|
+      games.each do |game, pockets|
+        low = pockets.map do |pocket|
+          hand = game == "omaha8" ? {"hand"=>pocket, "board"=>board} : {"hand"=>pocket + board}
+          value = PokerEval.eval_hand(hand.merge("side"=>"low"))["value"]
+          value == 0x0FFFFFFF ? nil : value
+        end
+        assert_equal(haslow, low.any?)
+        result = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board})
+        assert_equal(showdown_counts(low, "lo"), result["eval"].map { |e| e.slice("winlo", "tielo", "loselo") })
+      end
+    end
+  end
+
+  def test_eval_canonical()
+    pockets = [["as", "ks"], ["qs", "js"], ["__", "__"]]
+    board = ["2s", "3s", "4s", "__", "__"]
+    game = "holdem"
+    expect = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board})
+    result = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board, "canonical"=>true})
+    assert_equal(expect, result)
+  end
+
+  def test_eval_cache()
+    PokerEval.cache_clear
+    PokerEval.cache_size = 16
+    game = "holdem"
+    expect = PokerEval.eval({"game"=>game, "pockets"=>[["as", "ks"], ["qh", "jh"]], "board"=>["2c", "3d", "4s", "__", "__"]})
+    result = PokerEval.eval({"game"=>game, "pockets"=>[["qs", "js"], ["ah", "kh"]], "board"=>["2c", "3d", "4h", "__", "__"]})
+    assert_equal(expect["eval"].reverse, result["eval"])
+    assert_equal({"capacity"=>16, "entries"=>1, "hits"=>1, "misses"=>1}, PokerEval.cache_stats)
+    PokerEval.cache_size = 1024
+    boards = ["5c", "6c", "7c", "8c", "9c", "tc"].map { |card| ["2c", "3d", card, "__", "__"] }
+    boards.each { |board| PokerEval.eval({"game"=>game, "pockets"=>[["as", "ks"], ["qh", "jh"]], "board"=>board}) }
+    PokerEval.eval({"game"=>game, "pockets"=>[["as", "ks"], ["qh", "jh"]], "board"=>["2c", "3d", "4s", "__", "__"]})
+    boards.each { |board| PokerEval.eval({"game"=>game, "pockets"=>[["as", "ks"], ["qh", "jh"]], "board"=>board}) }
+    assert_equal({"capacity"=>1024, "entries"=>7, "hits"=>8, "misses"=>7}, PokerEval.cache_stats)
+    assert_raise(ArgumentError) { PokerEval.cache_size = -1 }
+    assert_equal(1024, PokerEval.cache_size)
+  ensure
+    PokerEval.cache_size = 0
+    PokerEval.cache_clear
+  end
+
+  def test_eval_preflop_table()
+    # every split of the four deuces between two pockets, each player
+    # winning two boards out of six
+    deuces = [0, 13, 26, 39]
+    keys = deuces.combination(2).map do |first|
+      second = deuces - first
+      first[0] | first[1] << 6 | second[0] << 12 | second[1] << 18
+    end
+    table = ["PKEVPF\0\0", 1, 16, keys.size, 6].pack("a8L4")
+    keys.sort.each { |key| table << [key, 2, 2, 2].pack("L4") }
+    file = Tempfile.new("preflop")
+    file.binmode
+    file.write(table)
+    file.close
+    assert_equal(keys.size, PokerEval.load_preflop_table(file.path))
+    result = PokerEval.eval({"game"=>"holdem", "pockets"=>[["2h", "2d"], ["2c", "2s"]], "board"=>["__", "__", "__", "__", "__"]})
+    assert_equal(6, result["info"]["samples"])
+    assert_equal([[2, 2, 2, 2, 500]] * 2, result["eval"].map { |e| e.values_at("scoop", "winhi", "losehi", "tiehi", "ev") })
+    # the same cards split 1 and 3 are not in the table
+    result = PokerEval.eval({"game"=>"holdem", "pockets"=>[["2h"], ["2d", "2c", "2s"]], "board"=>["__", "__", "__", "__", "__"]})
+    assert_equal(1712304, result["info"]["samples"])
+    assert_raise(ArgumentError) { PokerEval.generate_preflop_table(file.path, 0) }
+  ensure
+    PokerEval.load_preflop_table(nil)
+    file.unlink if file
+  end
+
+  def test_eval_ranges()
+    board = ["2c", "7d", "9h", "3s", "__"]
+    aces = ["s", "h", "d", "c"].combination(2).map { |suits| suits.map { |suit| "a" + suit } }
+    villain = ["s", "h", "d", "c"].map { |suit| [["k" + suit, "q" + suit], 0.5] } +
+      ["s", "h", "d", "c"].combination(2).map { |suits| [suits.map { |suit| "j" + suit }, 1.0] }
+    samples = winhi = 0.0
+    aces.each do |hero|
+      villain.each do |pocket, weight|
+        result = PokerEval.eval({"game"=>"holdem", "pockets"=>[hero, pocket], "board"=>board})
+        samples += weight * result["info"]["samples"]
+        winhi += weight * result["eval"][0]["winhi"]
+      end
+    end
+    result = PokerEval.eval({"game"=>"holdem", "pockets"=>["AA", "0.5:KQs,JJ"], "board"=>board})
+    assert_equal(1, result["info"]["exact"])
+    assert_equal(samples, result["info"]["samples"])
+    assert_equal(winhi, result["eval"][0]["winhi"])
+    args = {"game"=>"holdem", "pockets"=>["AA", "KK"], "board"=>board}
+    ["deadline_ms", "stderr", "histogram"].each do |option|
+      assert_raise(ArgumentError) { PokerEval.eval(args.merge(option=>20)) }
+    end
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("pockets"=>["AA", "ZZ"])) }
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("pockets"=>["AA", "22"], "dead"=>["2h", "2d", "2c"])) }
+  end
+
+  def test_eval_batch()
+    scenarios = [
+      {"game"=>"holdem", "pockets"=>[["tc", "ac"], ["th", "ah"], ["8c", "6h"]], "board"=>["7h", "3s", "2c", "7s", "7d"]},
+      {"game"=>"holdem8", "pockets"=>[["ac", "2c"], ["ad", "3h"], ["kh", "ks"]], "board"=>["4d", "5s", "9c", "__", "__"]},
+    ]
+    results = PokerEval.eval_batch(scenarios, "threads"=>2)
+    assert_equal(scenarios.size, results.size)
+    scenarios.each_with_index do |scenario, index|
+      expect = PokerEval.eval(scenario)
+      samples, players = results[index]
+      assert_equal(expect["info"]["samples"], samples)
+      assert_equal(expect["eval"].map { |e| e.values_at("scoop", "winhi", "losehi", "tiehi", "winlo", "loselo", "tielo", "ev") }, players)
+    end
+    # wakeups interrupt the batch without raising, it resumes where it was
+    scenarios *= 20
+    thread = Thread.new { PokerEval.eval_batch(scenarios) }
+    5.times { thread.wakeup rescue nil; Thread.pass }
+    assert_equal(PokerEval.eval_batch(scenarios), thread.value)
+    assert_raise(TypeError) { PokerEval.eval_batch(scenarios[0]) }
+    assert_raise(TypeError) { PokerEval.eval_batch(scenarios, 2) }
+    assert_raise(ArgumentError) { PokerEval.eval_batch(scenarios, "threads"=>0) }
+    assert_raise(TypeError) { PokerEval.eval_batch(scenarios, "threads"=>"2") }
+    # more cards to deal than the deck has left
+    crowded = {"game"=>"7stud", "pockets"=>[["__"] * 7] * 8, "board"=>[], "iterations"=>10}
+    assert_raise(ArgumentError) { PokerEval.eval_batch([crowded]) }
+    [{"histogram"=>4}, {"histogram_street"=>4}, {"streets"=>[3, 5]}, {"deadline_ms"=>20}, {"progress_every"=>100}].each do |option|
+      assert_raise(ArgumentError) { PokerEval.eval_batch([scenarios[1].merge(option)]) }
+    end
+  end
+
+  def test_eval_interrupt()
+    pockets = [["__", "__", "__", "__"], ["__", "__", "__", "__"], ["__", "__", "__", "__"]]
+    board = ["__", "__", "__", "__", "__"]
+    game = "omaha8"
+    assert_raise(Timeout::Error) do
+      Timeout.timeout(0.1) do
+        PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board})
+      end
+    end
+    # the last snapshot seen before the interrupt is partial
+    iterations = 1000000000
+    snapshot = nil
+    assert_raise(Timeout::Error) do
+      Timeout.timeout(0.1) do
+        PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board, "iterations"=>iterations, "progress_every"=>1000}) { |s| snapshot = s; nil }
+      end
+    end
+    assert_equal(1, snapshot["info"]["partial"])
+    assert_operator(snapshot["info"]["samples"], :<, iterations)
+  end
+
+  def test_eval_histogram()
+    # one bucket per turn equity, as one eval call per turn card counts it
+    args = {"game"=>"holdem", "pockets"=>[["As", "Ks"], ["Qh", "Qd"]], "board"=>["2s", "7s", "Jc", "__", "__"]}
+    result = PokerEval.eval(args.merge("histogram"=>10, "histogram_street"=>4, "threads"=>3))
+    deck = DECK - ["As", "Ks", "Qh", "Qd", "2s", "7s", "Jc"]
+    histograms = [Array.new(10, 0), Array.new(10, 0)]
+    deck.each do |turn|
+      expect = PokerEval.eval(args.merge("board"=>["2s", "7s", "Jc", turn, "__"]))
+      2.times do |player|
+        counts = expect["eval"][player]
+        equity = (counts["winhi"] + counts["tiehi"] / 2.0) / expect["info"]["samples"]
+        histograms[player][[(equity * 10).to_i, 9].min] += 1
+      end
+    end
+    assert_equal(deck.size, result["info"]["runouts"])
+    assert_equal(histograms, result["eval"].map { |player| player["histogram"] })
+    assert(result["eval"].all? { |player| player["ehs2"] > 0 && player["ehs2"] < 1 })
+    # the counts are those of the plain eval
+    plain = PokerEval.eval(args)
+    assert_equal(plain["eval"], result["eval"].map { |player| player.reject { |key, value| key == "histogram" || key == "ehs2" } })
+    assert_equal(100, PokerEval.eval(args.merge("histogram"=>4, "iterations"=>100, "seed"=>3))["info"]["runouts"])
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("histogram"=>4, "histogram_street"=>3)) }
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("histogram"=>0)) }
+    assert_raise(ArgumentError) { PokerEval.eval(args.merge("histogram"=>4, "compact"=>true)) }
+  end
+
+  def test_eval_streets()
+    # every street agrees with an eval of the board cut after it
+    [{"game"=>"holdem", "pockets"=>[["As", "Ks"], ["Qh", "Qd"]], "board"=>["2s", "7s", "Jc", "9d", "3s"], "threads"=>3},
+     {"game"=>"holdem8", "pockets"=>[["As", "2s"], ["Qh", "Qd"], ["3c", "4c"]], "board"=>["2h", "7s", "Jc", "9d", "__"], "canonical"=>true},
+     {"game"=>"holdem", "pockets"=>[["As", "Ks"], ["__", "__"]], "board"=>["2s", "7s", "Jc", "9d", "3s"]}].each do |args|
+      streets = args["board"].include?("__") ? [0, 3, 4] : [3, 4, 5]
+      result = PokerEval.eval_streets(args.merge("streets"=>streets))
+      expect = streets.map { |shown| PokerEval.eval(args.merge("board"=>args["board"][0, shown] + ["__"] * (5 - shown))) }
+      assert_equal(expect, result)
+    end
+    args = {"game"=>"holdem", "pockets"=>[["As", "Ks"], ["Qh", "Qd"]], "board"=>["2s", "7s", "Jc", "__", "__"]}
+    assert_raise(ArgumentError) { PokerEval.eval_streets(args.merge("streets"=>[3, 4])) }
+    assert_raise(ArgumentError) { PokerEval.eval_streets(args.merge("streets"=>[3, 3])) }
+    [{"iterations"=>1000}, {"deadline_ms"=>20}, {"stderr"=>1}, {"histogram"=>4}, {"histogram_street"=>4}].each do |option|
+      assert_raise(ArgumentError) { PokerEval.eval_streets(args.merge("streets"=>[3, 5]).merge(option)) }
+    end
+    assert_raise(ArgumentError) { PokerEval.eval_streets(args.merge("streets"=>[3, 5])) { |snapshot| nil } }
+  end
+
+  def test_showdown()
+    # showdowns agree with an eval of the same fully known hands
+    {"holdem"=>[2, 5], "holdem8"=>[2, 5], "omaha"=>[4, 5], "omaha8"=>[4, 5], "7stud"=>[7, 0], "7stud8"=>[7, 0], "razz"=>[7, 0]}.each do |game, (pocket_size, board_size)|
+      showdowns = random_deals(5, 50, 4 * pocket_size + board_size).map do |cards|
+        [cards[board_size..-1].each_slice(pocket_size).to_a, cards[0, board_size]]
+      end
+      results = PokerEval.showdown_many({"game"=>game, "showdowns"=>showdowns})
+      showdowns.each_with_index do |(pockets, board), i|
+        result = PokerEval.showdown({"game"=>game, "pockets"=>pockets, "board"=>board})
+        assert_equal(result, results[i])
+        expect = PokerEval.eval({"game"=>game, "pockets"=>pockets, "board"=>board})["eval"]
+        hi = (0...pockets.size).select { |player| expect[player]["winhi"] + expect[player]["tiehi"] == 1 }
+        low = (0...pockets.size).select { |player| expect[player]["winlo"] + expect[player]["tielo"] == 1 }
+        assert_equal(hi, result["hi"] || [])
+        assert_equal(low, result["low"] || [])
+        assert_equal({"hi"=>hi, "low"=>low}.reject { |side, winners| side == "low" && winners.empty? },
+                     PokerEval.winner({"game"=>game, "pockets"=>pockets, "board"=>board}))
+      end
+    end
+    assert_raise(ArgumentError) { PokerEval.showdown({"game"=>"holdem", "pockets"=>"AsKs", "board"=>[]}) }
+    assert_raise(ArgumentError) { PokerEval.showdown({"game"=>"holdem", "pockets"=>[["as", "ks"]] * 13, "board"=>[]}) }
+    assert_raise(ArgumentError) { PokerEval.showdown_many({"game"=>"holdem", "showdowns"=>{}}) }
+    assert_raise(ArgumentError) { PokerEval.showdown_many({"game"=>"holdem", "showdowns"=>[[[["as", "ks"]]]]}) }
+  end
+
   def test_best()
     hand = ["Ac", "As", "Td", "7s", "7h", "3s", "2c"]
     side = "hi"
@@ -33,5 +511,23 @@ class TC_PokerEval < Test::Unit::TestCase
     expect = {"value"=>67371008, "combination"=>["Straight", "6h", "5s", "4d", "3c", "2s"]}
     assert_equal(result, expect);
   end
-  
+
+  def test_best_many()
+    hands = random_deals(7, 300, 7).each_with_index.map { |cards, i| cards.first(5 + i % 3) }
+    %w(hi low).each do |side|
+      results = PokerEval.best_many({"side"=>side, "hands"=>hands})
+      hands.each_with_index do |hand, i|
+        assert_equal(PokerEval.best({"side"=>side, "hand"=>hand}), results[i])
+        # the best five are as good as any 5 card subset
+        values = hand.combination(5).map { |five| PokerEval.eval_hand({"side"=>side, "hand"=>five})["value"] }
+        assert_equal(side == "hi" ? values.max : values.min, results[i]["value"])
+        next if results[i]["combination"] == ["Nothing"]
+        five = results[i]["combination"][1..-1]
+        assert_equal([], five - hand)
+        assert_equal(results[i]["value"], PokerEval.eval_hand({"side"=>side, "hand"=>five})["value"])
+      end
+    end
+    assert_raise(ArgumentError) { PokerEval.eval_hand_many({"side"=>"hi", "hands"=>"AsKs"}) }
+  end
+
 end